@@ -9,13 +9,36 @@
 #include <unordered_set>
 #include <set>
 #include <map>
+#include <memory>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <algorithm>
+#include <numeric>
+#include <concepts>
+#include <type_traits>
+#include <span>
+#include <optional>
+#include <variant>
+#include <exception>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <ranges>
 
 namespace shipping {
     template<typename T> class NamedType {
         T t;
     public:
-        explicit NamedType(T t): t(t) {}
-        operator T() const {
+        explicit constexpr NamedType(T t): t(t) {}
+        constexpr operator T() const {
             return t;
         }
     };
@@ -34,359 +57,4415 @@ namespace shipping {
 
     using Position = std::tuple<X, Y, Height>;
 
+    /**
+     * Stable handle of a loaded container, stays the same while the container is moved around the ship
+     */
+    struct ContainerId {
+        std::uint32_t index;
+        std::uint32_t generation; // Tells apart containers that got the same index after one another
+
+        bool operator==(const ContainerId &) const = default;
+    };
+
+    /**
+     * Reason a ship operation failed
+     */
+    enum class ShipErrorCode : std::uint8_t {
+        BadX,
+        BadY,
+        NoSpaceToLoad,
+        NoContainerToUnload,
+        NoContainerToMove,
+        NoSpaceToMove,
+        NoSpaceForBatch,
+        UnknownContainer,
+        ContainerNotOnTop,
+        NoSpaceOnShip
+    };
+
+    /**
+     * Compact description of a failed ship operation, the message is only built when asked for
+     */
+    struct ShipError {
+        ShipErrorCode code;
+        int x;
+        int y;
+        int bound = 0; // Ship X or ship Y, for bad coordinates
+
+        std::string message() const {
+            std::string position = "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
+            switch (code) {
+                case ShipErrorCode::BadX:
+                    return "received position with bad X value. X value is" + std::to_string(x) + ", ship X is " + std::to_string(bound);
+                case ShipErrorCode::BadY:
+                    return "received position with bad Y value. Y value is" + std::to_string(y) + ", ship Y is " + std::to_string(bound);
+                case ShipErrorCode::NoSpaceToLoad:
+                    return "Can't load container, no space left in position : " + position;
+                case ShipErrorCode::NoContainerToUnload:
+                    return "Can't unload container, no container found in position : " + position;
+                case ShipErrorCode::NoContainerToMove:
+                    return "Can't move container, no container found in source position : " + position;
+                case ShipErrorCode::NoSpaceToMove:
+                    return "Can't move container, no space left in target position : " + position;
+                case ShipErrorCode::NoSpaceForBatch:
+                    return "Can't load batch, not enough space left in position : " + position;
+                case ShipErrorCode::UnknownContainer:
+                    return "Can't unload container, it isn't loaded on the ship";
+                case ShipErrorCode::ContainerNotOnTop:
+                    return "Can't unload container, it isn't on top of position : " + position;
+                case ShipErrorCode::NoSpaceOnShip:
+                    return "Can't load container, no space left on the ship";
+            }
+            return "bad ship operation at position : " + position;
+        }
+    };
+
+    /**
+     * Result of a non-throwing ship operation, either a value or the error that prevented the operation
+     */
+    template<typename T>
+    class ShipResult {
+        std::variant<T, ShipError> result;
+
+    public:
+        ShipResult(T value) : result(std::in_place_index<0>, std::move(value)) {}
+
+        ShipResult(ShipError error) : result(std::in_place_index<1>, error) {}
+
+        bool hasValue() const {
+            return result.index() == 0;
+        }
+
+        explicit operator bool() const {
+            return hasValue();
+        }
+
+        T &value() {
+            return std::get<0>(result);
+        }
+
+        const T &value() const {
+            return std::get<0>(result);
+        }
+
+        const ShipError &error() const {
+            return std::get<1>(result);
+        }
+    };
+
+    template<>
+    class ShipResult<void> {
+        std::optional<ShipError> failure;
+
+    public:
+        ShipResult() = default;
+
+        ShipResult(ShipError error) : failure(error) {}
+
+        bool hasValue() const {
+            return !failure;
+        }
+
+        explicit operator bool() const {
+            return hasValue();
+        }
+
+        const ShipError &error() const {
+            return *failure;
+        }
+    };
 
     /**
      * Exception indicating bad operation occurred
      */
     class BadShipOperationException : std::exception {
     private:
-        std::string message;
+        std::optional<ShipError> error;
+        mutable std::string message;
+
+    public:
+        explicit BadShipOperationException(std::string msg) : message(std::move(msg)) {}
+
+        explicit BadShipOperationException(ShipError error) : error(error) {}
+
+        const char *what() const noexcept override {
+            if (error && message.empty()) {
+                message = error->message();
+            }
+            return message.c_str();
+        }
+    };
+
+
+    /**
+     * Short string stored inline, zero padded to N chars. Usable as an allocation free group key
+     */
+    template<std::size_t N>
+    struct FixedString {
+        char chars[N] = {};
+
+        constexpr FixedString() = default;
+
+        template<std::size_t M> requires (M <= N + 1)
+        constexpr FixedString(const char (&str)[M]) {
+            std::copy_n(str, M - 1, chars);
+        }
+
+        /**
+         * Keeps the first N chars of the given string
+         */
+        constexpr explicit FixedString(std::string_view str) {
+            std::copy_n(str.begin(), std::min(str.size(), N), chars);
+        }
+
+        constexpr std::string_view view() const {
+            return {chars, std::size_t(std::find(chars, chars + N, '\0') - chars)};
+        }
+
+        constexpr bool operator==(const FixedString &) const = default;
+    };
+
+    template<std::size_t M>
+    FixedString(const char (&)[M]) -> FixedString<M - 1>;
+
+    /**
+     * Types a grouping function may return: anything hashable and comparable, e.g. std::string, integral, enum or FixedString
+     */
+    template<typename Key>
+    concept GroupKeyType = std::equality_comparable<Key> && requires(const Key &key) {
+        { std::hash<Key>{}(key) } -> std::convertible_to<std::size_t>;
+    };
+
+    /**
+     * std::string hash that also accepts std::string_view, so lookups by literal or view don't build std::string temporaries
+     */
+    struct StringHash {
+        using is_transparent = void;
+
+        std::size_t operator()(std::string_view str) const noexcept {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    /**
+     * Hash, equality and lookup argument types of a group key, string keys are looked up by std::string_view
+     */
+    template<typename Key>
+    using GroupKeyHash = std::conditional_t<std::is_same_v<Key, std::string>, StringHash, std::hash<Key>>;
+
+    template<typename Key>
+    using GroupKeyEqual = std::conditional_t<std::is_same_v<Key, std::string>, std::equal_to<>, std::equal_to<Key>>;
+
+    template<typename Key>
+    using GroupKeyLookup = std::conditional_t<std::is_same_v<Key, std::string>, std::string_view, const Key &>;
+
+    template<typename Container, GroupKeyType Key = std::string>
+    using Grouping = std::unordered_map<std::string, std::function<Key(const Container &)>>;
+
+    /**
+     * Grouping functions that can be found by std::string_view
+     */
+    template<typename Container, GroupKeyType Key = std::string>
+    using GroupingLookup = std::unordered_map<std::string, std::function<Key(const Container &)>, StringHash, std::equal_to<>>;
+
+    /**
+     * Batches smaller than this compute their group keys on the calling thread
+     */
+    inline constexpr std::size_t parallelBatchSize = 1024;
+
+    /**
+     * How a scan over the ship runs, in the manner of std::execution::seq and std::execution::par
+     */
+    enum class ExecutionPolicy {
+        Sequenced, Parallel
+    };
+
+    /**
+     * Calls task(i) for every i in [0, count), spread over up to hardware_concurrency threads including the calling one.
+     * Returns once all calls are done, the first exception thrown by a call is rethrown
+     */
+    template<typename Task>
+    void parallelFor(std::size_t count, const Task &task) {
+        std::size_t workers = std::min<std::size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+        if (workers <= 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        std::atomic<std::size_t> next = 0;
+        auto work = [&] {
+            for (std::size_t i; (i = next++) < count;) {
+                task(i);
+            }
+        };
+        std::vector<std::future<void>> helpers;
+        for (std::size_t worker = 1; worker < workers; ++worker) {
+            helpers.push_back(std::async(std::launch::async, work));
+        }
+        work();
+        for (auto &helper: helpers) {
+            helper.get();
+        }
+    }
+
+    /**
+     * Container ids of a cargo arena and the reverse index from an id to the slot of its container.
+     * Indexes of unloaded containers are reused, their generation is bumped so stale ids aren't found.
+     * Indexes is std::vector, std::array or SharedIndexChunks of std::uint32_t with one element per slot
+     */
+    template<typename Indexes>
+    class ContainerIdTable {
+        static constexpr std::uint32_t none = ~std::uint32_t(0);
+
+        Indexes slots{};       // Slot of the container of each index, or the next free index for free ones
+        Indexes generations{}; // Current generation of each index
+        std::uint32_t freeIndex = none; // Head of the list of free indexes
+        std::uint32_t freshIndex = 0;   // Indexes from here on were never used
+
+    public:
+        explicit ContainerIdTable(std::size_t slotCount) {
+            if constexpr (requires { slots.resize(slotCount); }) {
+                slots.resize(slotCount);
+                generations.resize(slotCount);
+            }
+        }
+
+        ContainerId id(std::uint32_t index) const {
+            return {index, generations[index]};
+        }
+
+        /**
+         * Returns an unused index for a container loaded to the given slot
+         */
+        std::uint32_t acquire(std::uint32_t slot) {
+            std::uint32_t index = freshIndex;
+            if (freeIndex != none) {
+                index = freeIndex;
+                freeIndex = slots[index];
+            } else {
+                ++freshIndex;
+            }
+            slots[index] = slot;
+            return index;
+        }
+
+        /**
+         * Frees the index of an unloaded container, ids with its current generation aren't found from now on
+         */
+        void release(std::uint32_t index) {
+            ++generations[index];
+            slots[index] = freeIndex;
+            freeIndex = index;
+        }
+
+        void relocate(std::uint32_t index, std::uint32_t slot) {
+            slots[index] = slot;
+        }
+
+        /**
+         * Returns the slot of the container with the given id, or nothing if no loaded container has it
+         */
+        std::optional<std::uint32_t> slotOf(ContainerId id) const {
+            if (id.index >= freshIndex || generations[id.index] != id.generation) {
+                return std::nullopt;
+            }
+            return slots[id.index];
+        }
+    };
+
+    /**
+     * Id table indexes split into fixed size chunks that are shared between copies. Copying the indexes copies only the chunk
+     * pointers, a shared chunk is copied the first time one of its elements is changed
+     */
+    class SharedIndexChunks {
+        static constexpr std::size_t chunkBits = 12;
+        static constexpr std::size_t chunkSize = std::size_t(1) << chunkBits;
+        using Chunk = std::array<std::uint32_t, chunkSize>;
+
+        std::vector<std::shared_ptr<Chunk>> chunks;
+
+    public:
+        void resize(std::size_t count) {
+            chunks.resize((count + chunkSize - 1) >> chunkBits);
+            for (auto &chunk: chunks) {
+                if (!chunk) {
+                    chunk = std::make_shared<Chunk>();
+                }
+            }
+        }
+
+        std::uint32_t operator[](std::size_t index) const {
+            return (*chunks[index >> chunkBits])[index & (chunkSize - 1)];
+        }
+
+        std::uint32_t &operator[](std::size_t index) {
+            auto &chunk = chunks[index >> chunkBits];
+            if (chunk.use_count() > 1) {
+                chunk = std::make_shared<Chunk>(*chunk);
+            }
+            return (*chunk)[index & (chunkSize - 1)];
+        }
+    };
+
+    /**
+     * Container id table whose operations may be called from several threads without a lock.
+     * Callers changing a container hold the lock of its stack, slotOf may be called unlocked and is checked again under the lock.
+     * Free indexes are a lock-free list whose head is tagged, so an index popped and pushed back meanwhile fails the swap
+     */
+    class ConcurrentContainerIdTable {
+        static constexpr std::uint32_t none = ~std::uint32_t(0);
+
+        std::vector<std::atomic<std::uint32_t>> slots;       // Slot of the container of each index, or the next free index for free ones
+        std::vector<std::atomic<std::uint32_t>> generations; // Current generation of each index
+        std::atomic<std::uint64_t> freeHead = none;          // Tag in the high half, head of the list of free indexes in the low half
+        std::atomic<std::uint32_t> freshIndex = 0;           // Indexes from here on were never used
+
+        static std::uint64_t tagged(std::uint64_t head, std::uint32_t index) {
+            return ((head >> 32) + 1) << 32 | index;
+        }
+
+        /**
+         * Pops a free index, or takes a fresh one if the list is empty
+         */
+        std::uint32_t take() {
+            std::uint64_t head = freeHead.load(std::memory_order_acquire);
+            while (true) {
+                std::uint32_t index = std::uint32_t(head);
+                if (index != none) {
+                    if (freeHead.compare_exchange_weak(head, tagged(head, slots[index].load(std::memory_order_relaxed)),
+                                                       std::memory_order_acquire)) {
+                        return index;
+                    }
+                    continue;
+                }
+                std::uint32_t fresh = freshIndex.load(std::memory_order_relaxed);
+                if (fresh < slots.size()) {
+                    if (freshIndex.compare_exchange_weak(fresh, fresh + 1, std::memory_order_relaxed)) {
+                        return fresh;
+                    }
+                } else {
+                    // Every index is taken, the caller has space so another thread is about to push the index it released
+                    std::this_thread::yield();
+                }
+                head = freeHead.load(std::memory_order_acquire);
+            }
+        }
+
+    public:
+        explicit ConcurrentContainerIdTable(std::size_t slotCount) : slots(slotCount), generations(slotCount) {}
+
+        ContainerId id(std::uint32_t index) const {
+            return {index, generations[index].load(std::memory_order_relaxed)};
+        }
+
+        /**
+         * Returns an unused index for a container loaded to the given slot
+         */
+        std::uint32_t acquire(std::uint32_t slot) {
+            std::uint32_t index = take();
+            slots[index].store(slot, std::memory_order_relaxed);
+            return index;
+        }
+
+        /**
+         * Frees the index of an unloaded container, ids with its current generation aren't found from now on
+         */
+        void release(std::uint32_t index) {
+            generations[index].fetch_add(1, std::memory_order_relaxed);
+            std::uint64_t head = freeHead.load(std::memory_order_relaxed);
+            do {
+                slots[index].store(std::uint32_t(head), std::memory_order_relaxed);
+            } while (!freeHead.compare_exchange_weak(head, tagged(head, index), std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        void relocate(std::uint32_t index, std::uint32_t slot) {
+            slots[index].store(slot, std::memory_order_relaxed);
+        }
+
+        /**
+         * Returns the slot of the container with the given id, or nothing if no loaded container has it
+         */
+        std::optional<std::uint32_t> slotOf(ContainerId id) const {
+            if (id.index >= freshIndex.load(std::memory_order_relaxed) ||
+                generations[id.index].load(std::memory_order_relaxed) != id.generation) {
+                return std::nullopt;
+            }
+            return slots[id.index].load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * Heap storage of a cargo arena, dimensions are given at runtime
+     */
+    template<typename Container>
+    class DynamicCargoStorage {
+        int x;
+        int y;
+        int height;
+        std::allocator<Container> allocator;
+        Container *slots;
+
+    protected:
+        std::vector<int> heights; // Number of containers in each stack, packed by stack index
+        std::vector<int> capacities; // Number of containers each stack can hold
+        std::vector<std::uint64_t> occupied; // One bit per stack, set when the stack isn't empty
+        std::vector<std::uint32_t> slotIds; // Id index of the container in each slot
+        ContainerIdTable<std::vector<std::uint32_t>> ids;
+
+        DynamicCargoStorage(X x, Y y, Height height)
+                : x(x), y(y), height(height), slots(allocator.allocate(std::size_t(x) * y * height)),
+                  heights(x * y, 0), capacities(x * y, height), occupied((x * y + 63) / 64, 0),
+                  slotIds(std::size_t(x) * y * height), ids(std::size_t(x) * y * height) {}
+
+        /**
+         * Allocates slots for a copy of another storage, the containers themselves are copied by the arena
+         */
+        DynamicCargoStorage(const DynamicCargoStorage &other)
+                : x(other.x), y(other.y), height(other.height), slots(allocator.allocate(std::size_t(x) * y * height)),
+                  heights(other.heights), capacities(other.capacities), occupied(other.occupied),
+                  slotIds(other.slotIds), ids(other.ids) {}
+
+        /**
+         * Takes the slots of another storage, which is left with no stacks
+         */
+        DynamicCargoStorage(DynamicCargoStorage &&other) noexcept
+                : x(std::exchange(other.x, 0)), y(std::exchange(other.y, 0)), height(std::exchange(other.height, 0)),
+                  slots(std::exchange(other.slots, nullptr)), heights(std::move(other.heights)),
+                  capacities(std::move(other.capacities)), occupied(std::move(other.occupied)),
+                  slotIds(std::move(other.slotIds)), ids(std::move(other.ids)) {}
+
+        ~DynamicCargoStorage() {
+            allocator.deallocate(slots, std::size_t(x) * y * height);
+        }
+
+        DynamicCargoStorage &operator=(const DynamicCargoStorage &) = delete;
+
+        Container *slotData() const {
+            return slots;
+        }
+
+    public:
+        int sizeX() const {
+            return x;
+        }
+
+        int sizeY() const {
+            return y;
+        }
+
+        int sizeHeight() const {
+            return height;
+        }
+
+        void swap(DynamicCargoStorage &other) noexcept {
+            std::swap(x, other.x);
+            std::swap(y, other.y);
+            std::swap(height, other.height);
+            std::swap(slots, other.slots);
+            heights.swap(other.heights);
+            capacities.swap(other.capacities);
+            occupied.swap(other.occupied);
+            slotIds.swap(other.slotIds);
+            std::swap(ids, other.ids);
+        }
+    };
+
+    /**
+     * In-place storage of a cargo arena, dimensions are known at compile time so nothing is allocated
+     */
+    template<typename Container, int ShipX, int ShipY, int ShipHeight>
+    class StaticCargoStorage {
+        static constexpr int stackCount = ShipX * ShipY;
+
+        alignas(Container) std::array<std::byte, sizeof(Container) * stackCount * ShipHeight> slots;
+
+    protected:
+        std::array<int, stackCount> heights{};
+        std::array<int, stackCount> capacities = [] {
+            std::array<int, stackCount> full{};
+            full.fill(ShipHeight);
+            return full;
+        }();
+        std::array<std::uint64_t, (stackCount + 63) / 64> occupied{};
+        std::array<std::uint32_t, stackCount * ShipHeight> slotIds;
+        ContainerIdTable<std::array<std::uint32_t, stackCount * ShipHeight>> ids{stackCount * ShipHeight};
+
+        StaticCargoStorage(X, Y, Height) {}
+
+        StaticCargoStorage(const StaticCargoStorage &) = delete;
+
+        StaticCargoStorage &operator=(const StaticCargoStorage &) = delete;
+
+        Container *slotData() const {
+            return reinterpret_cast<Container *>(const_cast<std::byte *>(slots.data()));
+        }
+
+    public:
+        static constexpr int sizeX() {
+            return ShipX;
+        }
+
+        static constexpr int sizeY() {
+            return ShipY;
+        }
+
+        static constexpr int sizeHeight() {
+            return ShipHeight;
+        }
+    };
+
+    /**
+     * Contiguous storage for all the slots of a ship.
+     * Stack s = x * Y + y owns the run of slots [s * H, (s + 1) * H), so slot (x, y, h) lives at x*Y*H + y*H + h.
+     * The storage is never reallocated, so references to loaded containers stay valid. Storage decides where the slots live
+     */
+    template<typename Container, typename Storage = DynamicCargoStorage<Container>>
+    class CargoArena : public Storage {
+        using Storage::heights;
+        using Storage::capacities;
+        using Storage::occupied;
+        using Storage::slotIds;
+        using Storage::ids;
+
+        static constexpr int wordBits = 64;
+
+        void setOccupied(int stack) {
+            occupied[stack / wordBits] |= std::uint64_t(1) << (stack % wordBits);
+        }
+
+        void clearOccupied(int stack) {
+            occupied[stack / wordBits] &= ~(std::uint64_t(1) << (stack % wordBits));
+        }
+
+        std::uint32_t slotIndex(int stack, int height) const {
+            return std::uint32_t(stack) * this->sizeHeight() + height;
+        }
+
+    public:
+        static constexpr bool copyOnWrite = false;
+        static constexpr bool concurrentWrites = false;
+
+        /**
+         * Read-only access to the stacks bound to the storage of the arena rather than to the arena object,
+         * so views holding it keep showing the stacks after the arena is moved
+         */
+        class Handle {
+            const Container *slots = nullptr;
+            const int *heights = nullptr;
+            const std::uint64_t *occupied = nullptr;
+            int stacks = 0;
+            int y = 0;
+            int stackHeight = 0;
+
+        public:
+            explicit Handle(const CargoArena &arena)
+                    : slots(arena.slotData()), heights(arena.heights.data()), occupied(arena.occupied.data()),
+                      stacks(arena.size()), y(arena.sizeY()), stackHeight(arena.sizeHeight()) {}
+
+            Handle() = default;
+
+            int size() const {
+                return stacks;
+            }
+
+            int sizeY() const {
+                return y;
+            }
+
+            int sizeHeight() const {
+                return stackHeight;
+            }
+
+            int height(int stack) const {
+                return heights[stack];
+            }
+
+            const Container *stackBase(int stack) const {
+                return slots + std::size_t(stack) * stackHeight;
+            }
+
+            const Container &at(int stack, int height) const {
+                return stackBase(stack)[height];
+            }
+
+            /**
+             * Returns the first non-empty stack starting from the given one, or size() if there is none
+             */
+            int nextOccupied(int stack) const {
+                if (stack >= stacks) {
+                    return stacks;
+                }
+                std::size_t word = stack / wordBits, words = (std::size_t(stacks) + wordBits - 1) / wordBits;
+                // Mask out the stacks before the given one in its word, then skip empty words in bulk
+                std::uint64_t bits = occupied[word] & (~std::uint64_t(0) << (stack % wordBits));
+                while (bits == 0) {
+                    if (++word == words) {
+                        return stacks;
+                    }
+                    bits = occupied[word];
+                }
+                return int(word * wordBits) + std::countr_zero(bits);
+            }
+        };
+
+        CargoArena(X x, Y y, Height height) : Storage(x, y, height) {}
+
+        /**
+         * Copies every container of another arena to the same slot
+         */
+        CargoArena(const CargoArena &other) requires std::is_copy_constructible_v<Container>: Storage(other) {
+            int stack = 0;
+            try {
+                for (; stack < size(); ++stack) {
+                    std::uninitialized_copy_n(other.stackBase(stack), heights[stack], stackBase(stack));
+                }
+            } catch (...) {
+                while (stack-- > 0) {
+                    std::destroy_n(stackBase(stack), heights[stack]);
+                }
+                throw;
+            }
+        }
+
+        CargoArena(CargoArena &&) noexcept = default;
+
+        ~CargoArena() {
+            for (int stack = 0; stack < size(); ++stack) {
+                std::destroy_n(stackBase(stack), heights[stack]);
+            }
+        }
+
+        /**
+         * Returns the number of stacks
+         */
+        constexpr int size() const {
+            return this->sizeX() * this->sizeY();
+        }
+
+        int height(int stack) const {
+            return heights[stack];
+        }
+
+        /**
+         * Returns how many more containers the given stack can hold
+         */
+        int spacesLeft(int stack) const {
+            return capacities[stack] - heights[stack];
+        }
+
+        /**
+         * Limits the number of containers the given stack can hold, called before anything is loaded
+         */
+        void restrict(int stack, int capacity) {
+            capacities[stack] = capacity;
+        }
+
+        /**
+         * Returns the first non-empty stack starting from the given one, or size() if there is none
+         */
+        int nextOccupied(int stack) const {
+            return handle().nextOccupied(stack);
+        }
+
+        Handle handle() const {
+            return Handle(*this);
+        }
+
+        /**
+         * Returns the number of non-empty stacks
+         */
+        int occupiedCount() const {
+            int count = 0;
+            for (std::uint64_t bits: occupied) {
+                count += std::popcount(bits);
+            }
+            return count;
+        }
+
+        Container *stackBase(int stack) {
+            return this->slotData() + std::size_t(stack) * this->sizeHeight();
+        }
+
+        const Container *stackBase(int stack) const {
+            return this->slotData() + std::size_t(stack) * this->sizeHeight();
+        }
+
+        const Container &at(int stack, int height) const {
+            return stackBase(stack)[height];
+        }
+
+        ContainerId idAt(int stack, int height) const {
+            return ids.id(slotIds[slotIndex(stack, height)]);
+        }
+
+        /**
+         * Returns the (stack, height) of the container with the given id, or nothing if no loaded container has it
+         */
+        std::optional<std::pair<int, int>> locate(ContainerId id) const {
+            auto slot = ids.slotOf(id);
+            if (!slot) {
+                return std::nullopt;
+            }
+            return std::pair<int, int>(*slot / this->sizeHeight(), *slot % this->sizeHeight());
+        }
+
+        /**
+         * Constructs container on top of the given stack from the given arguments, caller is responsible to check there is space left
+         */
+        template<typename... Args>
+        Container &emplace(int stack, Args &&... args) {
+            Container *top = std::construct_at(stackBase(stack) + heights[stack], std::forward<Args>(args)...);
+            std::uint32_t slot = slotIndex(stack, heights[stack]);
+            slotIds[slot] = ids.acquire(slot);
+            if (heights[stack]++ == 0) {
+                setOccupied(stack);
+            }
+            return *top;
+        }
+
+        /**
+         * Moves the top container of one stack to the top of another and returns it in its new slot,
+         * caller is responsible to check the source isn't empty and the target has space left
+         */
+        Container &transfer(int fromStack, int toStack) {
+            Container *from = stackBase(fromStack) + heights[fromStack] - 1;
+            Container *to = std::construct_at(stackBase(toStack) + heights[toStack], std::move(*from));
+            std::destroy_at(from);
+            std::uint32_t toSlot = slotIndex(toStack, heights[toStack]);
+            slotIds[toSlot] = slotIds[slotIndex(fromStack, heights[fromStack] - 1)];
+            ids.relocate(slotIds[toSlot], toSlot);
+            if (--heights[fromStack] == 0) {
+                clearOccupied(fromStack);
+            }
+            if (heights[toStack]++ == 0) {
+                setOccupied(toStack);
+            }
+            return *to;
+        }
+
+        /**
+         * Removes the top container of the given stack and returns it, caller is responsible to check the stack isn't empty
+         */
+        Container pop(int stack) {
+            Container *top = stackBase(stack) + heights[stack] - 1;
+            Container c = std::move(*top);
+            std::destroy_at(top);
+            ids.release(slotIds[slotIndex(stack, heights[stack] - 1)]);
+            if (--heights[stack] == 0) {
+                clearOccupied(stack);
+            }
+            return c;
+        }
+    };
+
+    /**
+     * Cargo arena whose stacks are shared between a ship and its clones.
+     * Copying the arena shares everything, detach() gives the copy its own stack before the stack is changed,
+     * copying only the bay of the stack and the stack itself. Stacks are never reallocated while they are owned by one arena
+     */
+    template<typename Container>
+    class SharedCargoArena {
+        struct Stack {
+            std::vector<Container> containers; // Reserved to the stack capacity on first load
+            std::vector<std::uint32_t> slotIds; // Id index of each container
+            int height = 0; // Number of containers in the stack, lets views see later loads and unloads
+        };
+        using Bay = std::vector<std::shared_ptr<Stack>>;
+        using Bays = std::vector<std::shared_ptr<Bay>>;
+
+        int x;
+        int y;
+        int maxHeight;
+        // Current bays of the arena behind a pointer that moves with the arena, so handles follow a moved arena
+        std::unique_ptr<std::shared_ptr<Bays>> bays;
+        std::shared_ptr<std::vector<int>> capacities; // Number of containers each stack can hold, set before anything is loaded
+        // The table is copied on the first change while shared, which copies only the pointers to its chunks
+        std::shared_ptr<ContainerIdTable<SharedIndexChunks>> ids;
+
+        ContainerIdTable<SharedIndexChunks> &writableIds() {
+            if (ids.use_count() > 1) {
+                ids = std::make_shared<ContainerIdTable<SharedIndexChunks>>(*ids);
+            }
+            return *ids;
+        }
+
+        std::uint32_t slotIndex(int stack, int height) const {
+            return std::uint32_t(stack) * maxHeight + height;
+        }
+
+        /**
+         * Reserves a stack to its capacity on first load, so its containers aren't reallocated later
+         */
+        void reserve(Stack &target, int stack) {
+            if (target.containers.capacity() == 0) {
+                target.containers.reserve((*capacities)[stack]);
+                target.slotIds.reserve((*capacities)[stack]);
+            }
+        }
+
+        const Stack &stackAt(int stack) const {
+            return *(*(**bays)[stack / y])[stack % y];
+        }
+
+        Stack &stackAt(int stack) {
+            return *(*(**bays)[stack / y])[stack % y];
+        }
+
+    public:
+        static constexpr bool copyOnWrite = true;
+        static constexpr bool concurrentWrites = false;
+
+        /**
+         * Read-only access to the stacks bound to the current bays of the arena rather than to the arena object,
+         * so views holding it see stacks detached later and keep showing the stacks after the arena is moved
+         */
+        class Handle {
+            const std::shared_ptr<Bays> *bays = nullptr;
+            int x = 0;
+            int y = 0;
+            int maxHeight = 0;
+
+            const Stack &stackAt(int stack) const {
+                return *(*(**bays)[stack / y])[stack % y];
+            }
+
+        public:
+            explicit Handle(const SharedCargoArena &arena) : bays(arena.bays.get()), x(arena.x), y(arena.y), maxHeight(arena.maxHeight) {}
+
+            Handle() = default;
+
+            int size() const {
+                return x * y;
+            }
+
+            int sizeY() const {
+                return y;
+            }
+
+            int sizeHeight() const {
+                return maxHeight;
+            }
+
+            int height(int stack) const {
+                return stackAt(stack).height;
+            }
+
+            const Container *stackBase(int stack) const {
+                return stackAt(stack).containers.data();
+            }
+
+            const Container &at(int stack, int height) const {
+                return stackAt(stack).containers[height];
+            }
+
+            /**
+             * Returns the first non-empty stack starting from the given one, or size() if there is none
+             */
+            int nextOccupied(int stack) const {
+                while (stack < size() && stackAt(stack).height == 0) {
+                    ++stack;
+                }
+                return std::min(stack, size());
+            }
+        };
+
+        /**
+         * Shares the stacks of another arena
+         */
+        SharedCargoArena(const SharedCargoArena &other)
+                : x(other.x), y(other.y), maxHeight(other.maxHeight), bays(other.bays ? std::make_unique<std::shared_ptr<Bays>>(*other.bays) : nullptr),
+                  capacities(other.capacities), ids(other.ids) {}
+
+        /**
+         * Takes the stacks of another arena, which is left with no stacks
+         */
+        SharedCargoArena(SharedCargoArena &&other) noexcept
+                : x(std::exchange(other.x, 0)), y(std::exchange(other.y, 0)), maxHeight(std::exchange(other.maxHeight, 0)),
+                  bays(std::move(other.bays)), capacities(std::move(other.capacities)), ids(std::move(other.ids)) {}
+
+        SharedCargoArena(X x, Y y, Height maxHeight)
+                : x(x), y(y), maxHeight(maxHeight), bays(std::make_unique<std::shared_ptr<Bays>>(std::make_shared<Bays>(x))),
+                  capacities(std::make_shared<std::vector<int>>(x * y, maxHeight)),
+                  ids(std::make_shared<ContainerIdTable<SharedIndexChunks>>(std::size_t(x) * y * maxHeight)) {
+            for (auto &bay: **bays) {
+                bay = std::make_shared<Bay>(y);
+                for (auto &stack: *bay) {
+                    stack = std::make_shared<Stack>();
+                }
+            }
+        }
+
+        int sizeX() const {
+            return x;
+        }
+
+        int sizeY() const {
+            return y;
+        }
+
+        int sizeHeight() const {
+            return maxHeight;
+        }
+
+        void swap(SharedCargoArena &other) noexcept {
+            std::swap(x, other.x);
+            std::swap(y, other.y);
+            std::swap(maxHeight, other.maxHeight);
+            bays.swap(other.bays);
+            capacities.swap(other.capacities);
+            ids.swap(other.ids);
+        }
+
+        int size() const {
+            return x * y;
+        }
+
+        int height(int stack) const {
+            return stackAt(stack).height;
+        }
+
+        /**
+         * Returns how many more containers the given stack can hold
+         */
+        int spacesLeft(int stack) const {
+            return (*capacities)[stack] - stackAt(stack).height;
+        }
+
+        /**
+         * Limits the number of containers the given stack can hold, called before anything is loaded
+         */
+        void restrict(int stack, int capacity) {
+            if (capacities.use_count() > 1) {
+                capacities = std::make_shared<std::vector<int>>(*capacities);
+            }
+            (*capacities)[stack] = capacity;
+        }
+
+        /**
+         * Returns the first non-empty stack starting from the given one, or size() if there is none
+         */
+        int nextOccupied(int stack) const {
+            return handle().nextOccupied(stack);
+        }
+
+        Handle handle() const {
+            return Handle(*this);
+        }
+
+        /**
+         * Gives this arena its own copy of the given stack if it's shared with another arena.
+         * Returns whether the stack was copied, its containers have new addresses then
+         */
+        bool detach(int stack) {
+            if (bays->use_count() > 1) {
+                *bays = std::make_shared<Bays>(**bays);
+            }
+            auto &bay = (**bays)[stack / y];
+            if (bay.use_count() > 1) {
+                bay = std::make_shared<Bay>(*bay);
+            }
+            auto &shared = (*bay)[stack % y];
+            if (shared.use_count() == 1) {
+                return false;
+            }
+            auto copy = std::make_shared<Stack>();
+            reserve(*copy, stack);
+            copy->containers.assign(shared->containers.begin(), shared->containers.end());
+            copy->slotIds.assign(shared->slotIds.begin(), shared->slotIds.end());
+            copy->height = shared->height;
+            shared = std::move(copy);
+            return true;
+        }
+
+        const Container *stackBase(int stack) const {
+            return stackAt(stack).containers.data();
+        }
+
+        const Container &at(int stack, int height) const {
+            return stackAt(stack).containers[height];
+        }
+
+        ContainerId idAt(int stack, int height) const {
+            return ids->id(stackAt(stack).slotIds[height]);
+        }
+
+        /**
+         * Returns the (stack, height) of the container with the given id, or nothing if no loaded container has it
+         */
+        std::optional<std::pair<int, int>> locate(ContainerId id) const {
+            auto slot = ids ? ids->slotOf(id) : std::nullopt;
+            if (!slot) {
+                return std::nullopt;
+            }
+            return std::pair<int, int>(*slot / maxHeight, *slot % maxHeight);
+        }
+
+        /**
+         * Constructs container on top of the given stack from the given arguments,
+         * caller is responsible to detach the stack and to check there is space left
+         */
+        template<typename... Args>
+        Container &emplace(int stack, Args &&... args) {
+            Stack &target = stackAt(stack);
+            reserve(target, stack);
+            Container &top = target.containers.emplace_back(std::forward<Args>(args)...);
+            target.slotIds.push_back(writableIds().acquire(slotIndex(stack, target.height++)));
+            return top;
+        }
+
+        /**
+         * Moves the top container of one stack to the top of another and returns it in its new slot,
+         * caller is responsible to detach both stacks and to check the source isn't empty and the target has space left
+         */
+        Container &transfer(int fromStack, int toStack) {
+            Stack &source = stackAt(fromStack), &target = stackAt(toStack);
+            reserve(target, toStack);
+            Container &moved = target.containers.emplace_back(std::move(source.containers.back()));
+            writableIds().relocate(source.slotIds.back(), slotIndex(toStack, target.height++));
+            target.slotIds.push_back(source.slotIds.back());
+            source.containers.pop_back();
+            source.slotIds.pop_back();
+            --source.height;
+            return moved;
+        }
+
+        /**
+         * Removes the top container of the given stack and returns it,
+         * caller is responsible to detach the stack and to check it isn't empty
+         */
+        Container pop(int stack) {
+            Stack &source = stackAt(stack);
+            Container c = std::move(source.containers.back());
+            source.containers.pop_back();
+            writableIds().release(source.slotIds.back());
+            source.slotIds.pop_back();
+            --source.height;
+            return c;
+        }
+    };
+
+    /**
+     * Contents of one stack, immutable once a snapshot shares it
+     */
+    template<typename Container>
+    struct StackVersion {
+        std::vector<Container> containers; // Reserved to the stack capacity on first load
+        std::vector<std::uint32_t> slotIds; // Id index of each container
+        int height = 0; // Number of containers in the stack, lets views see later loads and unloads
+    };
+
+    /**
+     * Cargo arena for concurrent ships whose stacks can be shared with snapshots.
+     * Every stack is held by its own shared_ptr and changed only under the lock of its stripe,
+     * a stack that is still shared with a snapshot is copied before it's changed
+     */
+    template<typename Container>
+    class VersionedCargoArena {
+        using Stack = StackVersion<Container>;
+
+        int x;
+        int y;
+        int maxHeight;
+        std::vector<std::shared_ptr<Stack>> stacks;
+        std::vector<int> capacities; // Number of containers each stack can hold, set before anything is loaded
+        ConcurrentContainerIdTable ids;
+
+        std::uint32_t slotIndex(int stack, int height) const {
+            return std::uint32_t(stack) * maxHeight + height;
+        }
+
+        /**
+         * Reserves a stack to its capacity on first load, so its containers aren't reallocated later
+         */
+        void reserve(Stack &target, int stack) {
+            if (target.containers.capacity() == 0) {
+                target.containers.reserve(capacities[stack]);
+                target.slotIds.reserve(capacities[stack]);
+            }
+        }
+
+    public:
+        static constexpr bool copyOnWrite = true;
+        static constexpr bool concurrentWrites = true; // Stacks of different stripes are written by different threads
+
+        /**
+         * Read-only access to the stacks bound to the stack pointers of the arena, which are never reallocated
+         */
+        class Handle {
+            const std::shared_ptr<Stack> *stacks = nullptr;
+            int x = 0;
+            int y = 0;
+            int maxHeight = 0;
+
+        public:
+            explicit Handle(const VersionedCargoArena &arena) : stacks(arena.stacks.data()), x(arena.x), y(arena.y), maxHeight(arena.maxHeight) {}
+
+            Handle() = default;
+
+            int size() const {
+                return x * y;
+            }
+
+            int sizeY() const {
+                return y;
+            }
+
+            int sizeHeight() const {
+                return maxHeight;
+            }
+
+            int height(int stack) const {
+                return stacks[stack]->height;
+            }
+
+            const Container *stackBase(int stack) const {
+                return stacks[stack]->containers.data();
+            }
+
+            const Container &at(int stack, int height) const {
+                return stacks[stack]->containers[height];
+            }
+
+            /**
+             * Returns the first non-empty stack starting from the given one, or size() if there is none
+             */
+            int nextOccupied(int stack) const {
+                while (stack < size() && stacks[stack]->height == 0) {
+                    ++stack;
+                }
+                return std::min(stack, size());
+            }
+        };
+
+        VersionedCargoArena(X x, Y y, Height maxHeight)
+                : x(x), y(y), maxHeight(maxHeight), stacks(x * y), capacities(x * y, maxHeight), ids(std::size_t(x) * y * maxHeight) {
+            for (auto &stack: stacks) {
+                stack = std::make_shared<Stack>();
+            }
+        }
+
+        VersionedCargoArena(const VersionedCargoArena &) = delete;
+
+        VersionedCargoArena &operator=(const VersionedCargoArena &) = delete;
+
+        int sizeX() const {
+            return x;
+        }
+
+        int sizeY() const {
+            return y;
+        }
+
+        int sizeHeight() const {
+            return maxHeight;
+        }
+
+        int size() const {
+            return x * y;
+        }
+
+        int height(int stack) const {
+            return stacks[stack]->height;
+        }
+
+        /**
+         * Returns how many more containers the given stack can hold
+         */
+        int spacesLeft(int stack) const {
+            return capacities[stack] - stacks[stack]->height;
+        }
+
+        /**
+         * Limits the number of containers the given stack can hold, called before anything is loaded
+         */
+        void restrict(int stack, int capacity) {
+            capacities[stack] = capacity;
+        }
+
+        /**
+         * Returns the first non-empty stack starting from the given one, or size() if there is none
+         */
+        int nextOccupied(int stack) const {
+            return handle().nextOccupied(stack);
+        }
+
+        Handle handle() const {
+            return Handle(*this);
+        }
+
+        /**
+         * Copies the given stack if a snapshot still holds it, caller holds the lock of the stack.
+         * Returns whether the stack was copied, its containers have new addresses then
+         */
+        bool detach(int stack) {
+            auto &shared = stacks[stack];
+            if (shared.use_count() == 1) {
+                // Pairs with the release of the last snapshot reference, so its reads happen before our writes
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return false;
+            }
+            auto copy = std::make_shared<Stack>();
+            reserve(*copy, stack);
+            copy->containers.assign(shared->containers.begin(), shared->containers.end());
+            copy->slotIds.assign(shared->slotIds.begin(), shared->slotIds.end());
+            copy->height = shared->height;
+            shared = std::move(copy);
+            return true;
+        }
+
+        /**
+         * Shares the current version of the stacks in [from, to) into the same indexes of versions, caller holds their locks
+         */
+        void share(int from, int to, std::vector<std::shared_ptr<const Stack>> &versions) const {
+            std::copy(stacks.begin() + from, stacks.begin() + to, versions.begin() + from);
+        }
+
+        const Container *stackBase(int stack) const {
+            return stacks[stack]->containers.data();
+        }
+
+        const Container &at(int stack, int height) const {
+            return stacks[stack]->containers[height];
+        }
+
+        ContainerId idAt(int stack, int height) const {
+            return ids.id(stacks[stack]->slotIds[height]);
+        }
+
+        /**
+         * Returns the (stack, height) of the container with the given id, or nothing if no loaded container has it
+         */
+        std::optional<std::pair<int, int>> locate(ContainerId id) const {
+            auto slot = ids.slotOf(id);
+            if (!slot) {
+                return std::nullopt;
+            }
+            return std::pair<int, int>(*slot / maxHeight, *slot % maxHeight);
+        }
+
+        /**
+         * Constructs container on top of the given stack from the given arguments,
+         * caller is responsible to detach the stack and to check there is space left
+         */
+        template<typename... Args>
+        Container &emplace(int stack, Args &&... args) {
+            Stack &target = *stacks[stack];
+            reserve(target, stack);
+            Container &top = target.containers.emplace_back(std::forward<Args>(args)...);
+            target.slotIds.push_back(ids.acquire(slotIndex(stack, target.height++)));
+            return top;
+        }
+
+        /**
+         * Moves the top container of one stack to the top of another and returns it in its new slot,
+         * caller is responsible to detach both stacks and to check the source isn't empty and the target has space left
+         */
+        Container &transfer(int fromStack, int toStack) {
+            Stack &source = *stacks[fromStack], &target = *stacks[toStack];
+            reserve(target, toStack);
+            Container &moved = target.containers.emplace_back(std::move(source.containers.back()));
+            ids.relocate(source.slotIds.back(), slotIndex(toStack, target.height++));
+            target.slotIds.push_back(source.slotIds.back());
+            source.containers.pop_back();
+            source.slotIds.pop_back();
+            --source.height;
+            return moved;
+        }
+
+        /**
+         * Removes the top container of the given stack and returns it,
+         * caller is responsible to detach the stack and to check it isn't empty
+         */
+        Container pop(int stack) {
+            Stack &source = *stacks[stack];
+            Container c = std::move(source.containers.back());
+            source.containers.pop_back();
+            ids.release(source.slotIds.back());
+            source.slotIds.pop_back();
+            --source.height;
+            return c;
+        }
+    };
+
+    /**
+     * How loadAuto picks a stack, ties go to the lowest stack in (x, y) order
+     */
+    enum class PlacementPolicy {
+        FirstFit,    // First stack with space left
+        BestFit,     // Stack with the least space left, fills open stacks before starting new ones
+        LowestStack, // Stack with the fewest containers
+        Balanced     // Stack with the most space left
+    };
+
+    /**
+     * Dimensions of an arena known at compile time, 0 for arenas sized at runtime.
+     * Ships over such an arena keep their indexes in place like their cargo, so they allocate nothing
+     */
+    template<typename Arena>
+    struct FixedDimensions {
+        static constexpr int x = 0;
+        static constexpr int y = 0;
+        static constexpr int height = 0;
+    };
+
+    template<typename Container, int ShipX, int ShipY, int ShipHeight>
+    struct FixedDimensions<CargoArena<Container, StaticCargoStorage<Container, ShipX, ShipY, ShipHeight>>> {
+        static constexpr int x = ShipX;
+        static constexpr int y = ShipY;
+        static constexpr int height = ShipHeight;
+    };
+
+    /**
+     * Elements of an index, in place when their count is known at compile time and on the heap when it's 0
+     */
+    template<typename T, std::size_t Count>
+    using IndexStorage = std::conditional_t<Count == 0, std::vector<T>, std::array<T, Count>>;
+
+    /**
+     * Vector of at most Capacity elements kept in place, for indexes of ships whose dimensions are known at compile time
+     */
+    template<typename T, std::size_t Capacity>
+    class InPlaceVector {
+        std::array<T, Capacity> elements{};
+        std::size_t count = 0;
+
+    public:
+        std::size_t size() const {
+            return count;
+        }
+
+        void push_back(const T &value) {
+            elements[count++] = value;
+        }
+
+        void pop_back() {
+            --count;
+        }
+
+        const T &back() const {
+            return elements[count - 1];
+        }
+
+        T &operator[](std::size_t index) {
+            return elements[index];
+        }
+
+        const T &operator[](std::size_t index) const {
+            return elements[index];
+        }
+
+        const T *begin() const {
+            return elements.data();
+        }
+
+        const T *end() const {
+            return elements.data() + count;
+        }
+    };
+
+    /**
+     * Segment tree over the stacks of a ship keeping the space left and height of the stacks that aren't full,
+     * so the stack a placement policy picks is found and updated in O(log stacks).
+     * FixedStacks is the number of stacks known at compile time, the tree is kept in place then
+     */
+    template<int FixedStacks = 0>
+    class StackSpaceTree {
+        static constexpr int none = std::numeric_limits<int>::max();
+
+        struct Node {
+            int maxFree = 0;
+            int minFree = none;   // Least space left among stacks that aren't full
+            int minHeight = none; // Least height among stacks that aren't full
+        };
+
+        std::size_t leaves;
+        IndexStorage<Node, FixedStacks == 0 ? 0 : 2 * std::bit_ceil(std::size_t(FixedStacks))> nodes{}; // nodes[1] is the root, the node of stack i is nodes[leaves + i]
+
+        static Node leaf(int height, int free) {
+            return free > 0 ? Node{free, free, height} : Node{};
+        }
+
+        static Node combine(const Node &left, const Node &right) {
+            return {std::max(left.maxFree, right.maxFree), std::min(left.minFree, right.minFree), std::min(left.minHeight, right.minHeight)};
+        }
+
+    public:
+        StackSpaceTree(int stacks, int height) : leaves(std::bit_ceil(std::size_t(std::max(stacks, 1)))) {
+            if constexpr (requires { nodes.resize(0); }) {
+                nodes.resize(2 * leaves);
+            }
+            std::fill_n(nodes.begin() + leaves, stacks, leaf(0, height));
+            for (std::size_t i = leaves - 1; i > 0; --i) {
+                nodes[i] = combine(nodes[2 * i], nodes[2 * i + 1]);
+            }
+        }
+
+        /**
+         * Sets the height and space left of the given stack
+         */
+        void update(int stack, int height, int free) {
+            std::size_t i = leaves + stack;
+            nodes[i] = leaf(height, free);
+            for (i /= 2; i > 0; i /= 2) {
+                nodes[i] = combine(nodes[2 * i], nodes[2 * i + 1]);
+            }
+        }
+
+        /**
+         * Returns the stack the given policy picks, or nullopt if all stacks are full
+         */
+        std::optional<int> find(PlacementPolicy policy) const {
+            if (nodes.size() < 2) { // Moved from
+                return std::nullopt;
+            }
+            const Node &root = nodes[1];
+            if (root.maxFree == 0) {
+                return std::nullopt;
+            }
+            // Descend to the leftmost leaf holding the root's value of the policy
+            auto holds = [&](const Node &node) {
+                switch (policy) {
+                    case PlacementPolicy::BestFit:
+                        return node.minFree == root.minFree;
+                    case PlacementPolicy::LowestStack:
+                        return node.minHeight == root.minHeight;
+                    case PlacementPolicy::Balanced:
+                        return node.maxFree == root.maxFree;
+                    default:
+                        return node.maxFree > 0;
+                }
+            };
+            std::size_t i = 1;
+            while (i < leaves) {
+                i = holds(nodes[2 * i]) ? 2 * i : 2 * i + 1;
+            }
+            return int(i - leaves);
+        }
+    };
+
+    /**
+     * Stacks that have a container at each height of the ship. Every layer is a dense list of stacks and every slot keeps
+     * the index of its stack in the list, so a stack joins or leaves a layer in O(1) and a layer is iterated in O(its size).
+     * FixedStacks and FixedHeight are the dimensions known at compile time, the layers are kept in place then
+     */
+    template<int FixedStacks = 0, int FixedHeight = 0>
+    class LayerIndex {
+        static constexpr std::size_t fixedLayers = FixedStacks == 0 ? 0 : FixedHeight;
+
+    public:
+        using Layer = std::conditional_t<fixedLayers == 0, std::vector<std::uint32_t>, InPlaceVector<std::uint32_t, FixedStacks>>;
+
+    private:
+        int shipHeight;
+        IndexStorage<Layer, fixedLayers> layers{};                        // layers[h] has the stacks with a container at height h
+        IndexStorage<std::uint32_t, fixedLayers * FixedStacks> indexes{}; // Index of the stack in its layer, by the slot key stack * height + h
+
+    public:
+        LayerIndex(int stacks, int height) : shipHeight(height) {
+            if constexpr (requires { layers.resize(0); }) {
+                layers.resize(height);
+                indexes.resize(std::size_t(stacks) * height);
+            }
+        }
+
+        void add(int stack, int height) {
+            auto &layer = layers[height];
+            indexes[std::size_t(stack) * shipHeight + height] = std::uint32_t(layer.size());
+            layer.push_back(std::uint32_t(stack));
+        }
+
+        void remove(int stack, int height) {
+            auto &layer = layers[height];
+            std::uint32_t index = indexes[std::size_t(stack) * shipHeight + height], last = layer.back();
+            layer[index] = last;
+            indexes[std::size_t(last) * shipHeight + height] = index;
+            layer.pop_back();
+        }
+
+        const Layer &layer(int height) const {
+            return layers[height];
+        }
+
+        /**
+         * Returns all layers from the bottom up, the span stays valid when the index is moved
+         */
+        std::span<const Layer> allLayers() const {
+            return layers;
+        }
+    };
+
+    /**
+     * Container count of every stack in a 2D Fenwick tree and stack capacities in 2D prefix sums,
+     * so the count and free space of a rectangle of stacks take O(log X * log Y) and O(1).
+     * With Atomic the counts are updated through std::atomic_ref, stacks of different stripes may change concurrently.
+     * FixedX and FixedY are the dimensions known at compile time, the counts are kept in place then
+     */
+    template<bool Atomic, int FixedX = 0, int FixedY = 0>
+    class RegionCounts {
+        static constexpr std::size_t fixedCells = std::size_t(FixedX) * FixedY == 0 ? 0 : std::size_t(FixedX + 1) * (FixedY + 1);
+
+        int sizeX;
+        int sizeY;
+        IndexStorage<int, fixedCells> tree{};                // 1-based (X + 1) x (Y + 1) Fenwick tree of container counts
+        IndexStorage<std::int64_t, fixedCells> capacities{}; // (X + 1) x (Y + 1) prefix sums of stack capacities
+
+        std::size_t cell(int x, int y) const {
+            return std::size_t(x) * (sizeY + 1) + y;
+        }
+
+        /**
+         * Returns the number of containers in stacks [0, x) x [0, y)
+         */
+        std::int64_t prefixCount(int x, int y) const {
+            std::int64_t sum = 0;
+            for (int i = x; i > 0; i -= i & -i) {
+                for (int j = y; j > 0; j -= j & -j) {
+                    if constexpr (Atomic) {
+                        sum += std::atomic_ref<int>(const_cast<int &>(tree[cell(i, j)])).load(std::memory_order_relaxed);
+                    } else {
+                        sum += tree[cell(i, j)];
+                    }
+                }
+            }
+            return sum;
+        }
+
+        template<typename Prefix>
+        static std::int64_t rectangle(int x0, int y0, int x1, int y1, const Prefix &prefix) {
+            return prefix(x1 + 1, y1 + 1) - prefix(x0, y1 + 1) - prefix(x1 + 1, y0) + prefix(x0, y0);
+        }
+
+    public:
+        RegionCounts(int x, int y, int height) : sizeX(x), sizeY(y) {
+            if constexpr (requires { tree.resize(0); }) {
+                tree.resize(std::size_t(x + 1) * (y + 1));
+                capacities.resize(std::size_t(x + 1) * (y + 1));
+            }
+            setCapacities([height](int, int) { return height; });
+        }
+
+        /**
+         * Rebuilds the capacity prefix sums, capacityOf(x, y) gives the capacity of a stack
+         */
+        template<typename CapacityOf>
+        void setCapacities(const CapacityOf &capacityOf) {
+            for (int i = 1; i <= sizeX; ++i) {
+                for (int j = 1; j <= sizeY; ++j) {
+                    capacities[cell(i, j)] = capacityOf(i - 1, j - 1) + capacities[cell(i - 1, j)] + capacities[cell(i, j - 1)] - capacities[cell(i - 1, j - 1)];
+                }
+            }
+        }
+
+        /**
+         * Adds delta to the container count of the given stack
+         */
+        void add(int x, int y, int delta) {
+            for (int i = x + 1; i <= sizeX; i += i & -i) {
+                for (int j = y + 1; j <= sizeY; j += j & -j) {
+                    if constexpr (Atomic) {
+                        std::atomic_ref<int>(tree[cell(i, j)]).fetch_add(delta, std::memory_order_relaxed);
+                    } else {
+                        tree[cell(i, j)] += delta;
+                    }
+                }
+            }
+        }
+
+        /**
+         * Returns the number of containers in stacks [x0, x1] x [y0, y1]
+         */
+        std::int64_t count(int x0, int y0, int x1, int y1) const {
+            return rectangle(x0, y0, x1, y1, [this](int x, int y) { return prefixCount(x, y); });
+        }
+
+        /**
+         * Returns the total capacity of stacks [x0, x1] x [y0, y1]
+         */
+        std::int64_t capacity(int x0, int y0, int x1, int y1) const {
+            return rectangle(x0, y0, x1, y1, [this](int x, int y) { return capacities[cell(x, y)]; });
+        }
+
+        void swap(RegionCounts &other) noexcept {
+            std::swap(sizeX, other.sizeX);
+            std::swap(sizeY, other.sizeY);
+            tree.swap(other.tree);
+            capacities.swap(other.capacities);
+        }
+    };
+
+    /**
+     * Position of a container in a group together with the container itself
+     */
+    template<typename Container>
+    using GroupEntry = std::pair<const Position, const Container &>;
+
+    template<typename Container>
+    using GroupEntries = std::vector<GroupEntry<Container>>;
+
+    /**
+     * Numeric field of a container, e.g. its weight, kept summed, minimized and maximized in every group
+     */
+    template<typename Container>
+    struct NamedAggregate {
+        std::string name;
+        std::function<double(const Container &)> projection;
+    };
+
+    template<typename Container>
+    using Aggregates = std::vector<NamedAggregate<Container>>;
+
+    /**
+     * Sum, min and max of an aggregate over the containers of a group
+     */
+    struct AggregateStats {
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+    };
+
+    /**
+     * Count and aggregates of a group, copied out of the group when asked for
+     */
+    template<typename Container>
+    class GroupStats {
+        std::shared_ptr<const Aggregates<Container>> aggregates;
+        std::vector<AggregateStats> values;
+        std::size_t containers = 0;
+
+    public:
+        GroupStats(std::shared_ptr<const Aggregates<Container>> aggregates, std::vector<AggregateStats> values, std::size_t containers)
+                : aggregates(std::move(aggregates)), values(std::move(values)), containers(containers) {}
+
+        GroupStats() = default;
+
+        std::size_t count() const {
+            return containers;
+        }
+
+        /**
+         * Adds the containers and aggregates of another part of the same group
+         */
+        void merge(const GroupStats &other) {
+            if (other.containers == 0) {
+                return;
+            }
+            if (containers == 0) {
+                *this = other;
+                return;
+            }
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                values[i].sum += other.values[i].sum;
+                values[i].min = std::min(values[i].min, other.values[i].min);
+                values[i].max = std::max(values[i].max, other.values[i].max);
+            }
+            containers += other.containers;
+        }
+
+        /**
+         * Returns the stats of the given aggregate, or nullopt if there is no such aggregate or the group is empty
+         */
+        std::optional<AggregateStats> aggregate(std::string_view name) const {
+            if (containers == 0 || !aggregates) {
+                return std::nullopt;
+            }
+            for (std::size_t i = 0; i < aggregates->size(); ++i) {
+                if ((*aggregates)[i].name == name) {
+                    return values[i];
+                }
+            }
+            return std::nullopt;
+        }
+    };
+
+    /**
+     * Query combining groups of registered groupings, e.g. group("port", "Haifa") & ~group("type", "reefer").
+     * Evaluated over bitsets with a bit per (x, y, height) slot, NOT keeps only occupied slots
+     */
+    template<GroupKeyType Key>
+    class GroupQuery {
+        enum class Kind {
+            Group, And, Or, Not
+        };
+
+        struct Node {
+            Kind kind;
+            std::string grouping;
+            std::optional<Key> key;
+            std::shared_ptr<const Node> left;
+            std::shared_ptr<const Node> right;
+        };
+        std::shared_ptr<const Node> node;
+
+        explicit GroupQuery(Node n) : node(std::make_shared<const Node>(std::move(n))) {}
+
+        template<typename MarkGroup>
+        static void evaluate(const Node &n, const MarkGroup &markGroup, std::span<const std::uint64_t> occupied, std::vector<std::uint64_t> &result) {
+            if (n.kind == Kind::Group) {
+                std::fill(result.begin(), result.end(), 0);
+                markGroup(n.grouping, *n.key, std::span<std::uint64_t>(result));
+                return;
+            }
+            evaluate(*n.left, markGroup, occupied, result);
+            if (n.kind == Kind::Not) {
+                for (std::size_t i = 0; i < result.size(); ++i) {
+                    result[i] = ~result[i] & occupied[i];
+                }
+                return;
+            }
+            std::vector<std::uint64_t> other(result.size());
+            evaluate(*n.right, markGroup, occupied, other);
+            if (n.kind == Kind::And) {
+                for (std::size_t i = 0; i < result.size(); ++i) {
+                    result[i] &= other[i];
+                }
+            } else {
+                for (std::size_t i = 0; i < result.size(); ++i) {
+                    result[i] |= other[i];
+                }
+            }
+        }
+
+    public:
+        /**
+         * Matches the containers of the given group
+         */
+        static GroupQuery group(std::string grouping, Key key) {
+            return GroupQuery(Node{Kind::Group, std::move(grouping), std::move(key), nullptr, nullptr});
+        }
+
+        friend GroupQuery operator&(GroupQuery left, GroupQuery right) {
+            return GroupQuery(Node{Kind::And, {}, std::nullopt, std::move(left.node), std::move(right.node)});
+        }
+
+        friend GroupQuery operator|(GroupQuery left, GroupQuery right) {
+            return GroupQuery(Node{Kind::Or, {}, std::nullopt, std::move(left.node), std::move(right.node)});
+        }
+
+        friend GroupQuery operator~(GroupQuery query) {
+            return GroupQuery(Node{Kind::Not, {}, std::nullopt, std::move(query.node), nullptr});
+        }
+
+        /**
+         * Returns a bit per slot set for the matching slots. markGroup(grouping, key, bits) sets the slots of a group,
+         * occupied has the slots that hold containers. Word loops are plain so the compiler vectorizes them
+         */
+        template<typename MarkGroup>
+        std::vector<std::uint64_t> evaluate(const MarkGroup &markGroup, std::span<const std::uint64_t> occupied) const {
+            std::vector<std::uint64_t> result(occupied.size());
+            evaluate(*node, markGroup, occupied, result);
+            return result;
+        }
+    };
+
+    /**
+     * Container that was just placed in the ship, used to update the groups in bulk
+     */
+    template<typename Container>
+    struct PlacedContainer {
+        const Container *container;
+        Position position;
+    };
+
+    /**
+     * Groups of a single grouping function by their key.
+     * Each group is a dense vector of entries and every slot keeps a back-pointer to its entry, so removal is an O(1) swap-remove.
+     * A group exists only while it has entries, views bind to a key and find its group when iterated
+     */
+    template<typename Container, GroupKeyType Key>
+    class GroupTable {
+        using PositionToContainer = GroupEntries<Container>;
+
+        /**
+         * Running sum of an aggregate in a group, with the count of every value so min and max survive removals
+         */
+        struct AggregateState {
+            double sum = 0;
+            std::map<double, std::uint32_t> values;
+
+            void add(double value) {
+                sum += value;
+                ++values[value];
+            }
+
+            void remove(double value) {
+                sum -= value;
+                auto itr = values.find(value);
+                if (--itr->second == 0) {
+                    values.erase(itr);
+                }
+            }
+
+            AggregateStats stats() const {
+                return values.empty() ? AggregateStats{} : AggregateStats{sum, values.begin()->first, values.rbegin()->first};
+            }
+        };
+
+        /**
+         * Keys that may allocate are shared between a group and the views bound to it,
+         * so a view of an existing group copies no key and can still find the group again after a reclaim
+         */
+        static constexpr bool sharedKeys = !std::is_trivially_copyable_v<Key>;
+        using ViewKey = std::conditional_t<sharedKeys, std::shared_ptr<const Key>, Key>;
+
+        struct GroupData {
+            PositionToContainer entries;
+            std::vector<AggregateState> aggregates; // One per registered aggregate, in registration order
+            std::conditional_t<sharedKeys, std::shared_ptr<const Key>, std::monostate> viewKey;
+        };
+
+        using Groups = std::unordered_map<Key, GroupData, GroupKeyHash<Key>, GroupKeyEqual<Key>>;
+        using Group = typename Groups::value_type;
+
+        /**
+         * Back-pointer from a slot to its entry
+         */
+        struct GroupMembership {
+            Group *group;
+            std::uint32_t index;
+        };
+
+        int shipY;
+        int shipHeight;
+        int firstX; // First bay of the table
+        Groups groups;
+        std::vector<GroupMembership> ownMemberships; // Empty when the table writes memberships kept by its owner
+        std::span<GroupMembership> memberships; // Indexed by the packed (x - firstX)*Y*H + y*H + h slot key
+        std::uint64_t reclaimedCount = 0; // Number of groups reclaimed so far, lets views know their cached group is gone
+        std::shared_ptr<const Aggregates<Container>> aggregates;
+
+        /**
+         * Returns the packed key of the given position
+         */
+        std::size_t slotIndex(Position pos) const {
+            return (std::size_t(std::get<0>(pos) - firstX) * shipY + std::get<1>(pos)) * shipHeight + std::get<2>(pos);
+        }
+
+        /**
+         * Returns the group of the given key, creating it if there is none
+         */
+        Group &groupOf(const Key &key) {
+            auto[itr, created] = groups.try_emplace(key);
+            if constexpr (sharedKeys) {
+                if (created) {
+                    itr->second.viewKey = std::make_shared<const Key>(itr->first);
+                }
+            }
+            return *itr;
+        }
+
+        void addToAggregates(GroupData &group, const Container &container) {
+            if (!aggregates || aggregates->empty()) {
+                return;
+            }
+            group.aggregates.resize(aggregates->size());
+            for (std::size_t i = 0; i < aggregates->size(); ++i) {
+                group.aggregates[i].add((*aggregates)[i].projection(container));
+            }
+        }
+
+        void removeFromAggregates(GroupData &group, const Container &container) {
+            if (!aggregates || aggregates->empty()) {
+                return;
+            }
+            for (std::size_t i = 0; i < aggregates->size(); ++i) {
+                group.aggregates[i].remove((*aggregates)[i].projection(container));
+            }
+        }
+
+    public:
+        class GroupView;
+
+        using Memberships = std::vector<GroupMembership>;
+
+        /**
+         * Creates the groups of the slots of the given number of bays from firstX on
+         */
+        GroupTable(int bays, int shipY, int shipHeight, int firstX = 0)
+                : shipY(shipY), shipHeight(shipHeight), firstX(firstX), ownMemberships(std::size_t(bays) * shipY * shipHeight),
+                  memberships(ownMemberships) {}
+
+        /**
+         * Creates groups whose memberships are kept in the given vector of X*Y*H entries, shared by tables holding
+         * different groups of the same grouping. The vector outlives the table and isn't resized
+         */
+        GroupTable(Memberships &shared, int shipY, int shipHeight)
+                : shipY(shipY), shipHeight(shipHeight), firstX(0), memberships(shared) {}
+
+        /**
+         * Copies the groups of another table in one pass, locate(entry) gives the container the copy of the entry refers to
+         */
+        template<typename Locate>
+        GroupTable(const GroupTable &other, Locate locate)
+                : shipY(other.shipY), shipHeight(other.shipHeight), firstX(other.firstX), ownMemberships(other.memberships.size()),
+                  memberships(ownMemberships), aggregates(other.aggregates) {
+            groups.reserve(other.groups.size());
+            for (auto &[key, data]: other.groups) {
+                Group &group = *groups.try_emplace(key).first;
+                group.second.aggregates = data.aggregates;
+                group.second.viewKey = data.viewKey;
+                group.second.entries.reserve(data.entries.size());
+                for (auto &entry: data.entries) {
+                    memberships[slotIndex(entry.first)] = {&group, std::uint32_t(group.second.entries.size())};
+                    group.second.entries.emplace_back(entry.first, locate(entry));
+                }
+            }
+        }
+
+        /**
+         * Copies the groups of another table, the entries keep referring to the same containers
+         */
+        GroupTable(const GroupTable &other)
+                : GroupTable(other, [](const GroupEntry<Container> &entry) -> const Container & { return entry.second; }) {}
+
+        GroupTable(GroupTable &&) noexcept = default;
+
+        GroupTable &operator=(const GroupTable &) = delete;
+
+        /**
+         * Adds container to the group of the given key
+         */
+        void add(const Key &key, const Container &container, Position pos) {
+            Group &group = groupOf(key);
+            memberships[slotIndex(pos)] = {&group, std::uint32_t(group.second.entries.size())};
+            group.second.entries.emplace_back(pos, container);
+            addToAggregates(group.second, container);
+        }
+
+        /**
+         * Adds the given containers, keys[i] is the key of placed[i].
+         * Every group is looked up once per container and grows at most once
+         */
+        void addBatch(std::span<const Key> keys, std::span<const PlacedContainer<Container>> placed) {
+            std::vector<Group *> targets;
+            targets.reserve(keys.size());
+            std::unordered_map<Group *, std::size_t> added;
+            for (const Key &key: keys) {
+                Group *group = &groupOf(key);
+                targets.push_back(group);
+                ++added[group];
+            }
+            for (auto[group, count]: added) {
+                group->second.entries.reserve(group->second.entries.size() + count);
+            }
+            for (std::size_t i = 0; i < placed.size(); ++i) {
+                PositionToContainer &entries = targets[i]->second.entries;
+                memberships[slotIndex(placed[i].position)] = {targets[i], std::uint32_t(entries.size())};
+                entries.emplace_back(placed[i].position, *placed[i].container);
+                addToAggregates(targets[i]->second, *placed[i].container);
+            }
+        }
+
+        /**
+         * Removes the container at the given position from its group, the group is reclaimed if it's left empty
+         */
+        void remove(Position pos) {
+            auto[group, index] = memberships[slotIndex(pos)];
+            PositionToContainer &entries = group->second.entries;
+            removeFromAggregates(group->second, entries[index].second);
+            // Fill the hole with the last entry of the group and fix the back-pointer of the moved entry
+            if (index + 1 != entries.size()) {
+                GroupEntry<Container> &hole = entries[index];
+                std::destroy_at(&hole);
+                std::construct_at(&hole, entries.back());
+                memberships[slotIndex(hole.first)].index = index;
+            }
+            entries.pop_back();
+
+            if (entries.empty()) {
+                groups.erase(groups.find(group->first));
+                ++reclaimedCount;
+            }
+        }
+
+        /**
+         * Points the entry of the container at the given position to its new position, the container stays in the same group
+         */
+        void relocate(Position from, Position to, const Container &container) {
+            GroupMembership membership = memberships[slotIndex(from)];
+            GroupEntry<Container> &entry = membership.group->second.entries[membership.index];
+            std::destroy_at(&entry);
+            std::construct_at(&entry, to, container);
+            memberships[slotIndex(to)] = membership;
+        }
+
+        /**
+         * Returns the key of the group of the container at the given position
+         */
+        const Key &keyOf(Position pos) const {
+            return memberships[slotIndex(pos)].group->first;
+        }
+
+        /**
+         * Returns the entries of the given group, or nullptr if the group has no entries
+         */
+        const PositionToContainer *find(GroupKeyLookup<Key> key) const {
+            auto itr = groups.find(key);
+            return itr != groups.end() ? &itr->second.entries : nullptr;
+        }
+
+        /**
+         * Sets the bits of the slots of the given group, bits has a bit per x*Y*H + y*H + h slot key of the ship
+         */
+        void markGroup(GroupKeyLookup<Key> key, std::span<std::uint64_t> bits) const {
+            if (auto entries = find(key)) {
+                for (auto &entry: *entries) {
+                    auto[x, y, height] = entry.first;
+                    std::size_t slot = (std::size_t(x) * shipY + y) * shipHeight + height;
+                    bits[slot / 64] |= std::uint64_t(1) << (slot % 64);
+                }
+            }
+        }
+
+        /**
+         * Sets the aggregates kept in every group and computes them for the containers already in the groups
+         */
+        void setAggregates(std::shared_ptr<const Aggregates<Container>> functions) {
+            aggregates = std::move(functions);
+            for (auto &group: groups) {
+                group.second.aggregates.clear();
+                for (auto &entry: group.second.entries) {
+                    addToAggregates(group.second, entry.second);
+                }
+            }
+        }
+
+        /**
+         * Returns the count and aggregates of the given group in O(number of aggregates)
+         */
+        GroupStats<Container> stats(GroupKeyLookup<Key> key) const {
+            auto itr = groups.find(key);
+            if (itr == groups.end()) {
+                return GroupStats<Container>(aggregates, {}, 0);
+            }
+            std::vector<AggregateStats> values;
+            values.reserve(itr->second.aggregates.size());
+            for (auto &state: itr->second.aggregates) {
+                values.push_back(state.stats());
+            }
+            return GroupStats<Container>(aggregates, std::move(values), itr->second.entries.size());
+        }
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+        /**
+         * View for a specific group containers.
+         * Bound to the group key rather than to the group, so a view of an empty group sees later loads without creating the group
+         */
+        class GroupView : public std::ranges::view_interface<GroupView> {
+            const GroupTable *table = nullptr;
+            ViewKey key{};
+            mutable const PositionToContainer *pGroup = nullptr; // Cached group, valid while no group was reclaimed
+            mutable std::uint64_t reclaimedAtCache = 0;
+            using iterType = typename PositionToContainer::const_iterator;
+
+            const Key &keyValue() const {
+                if constexpr (sharedKeys) {
+                    return *key;
+                } else {
+                    return key;
+                }
+            }
+
+            const PositionToContainer *group() const {
+                if (table && (!pGroup || reclaimedAtCache != table->reclaimedCount)) {
+                    pGroup = table->find(keyValue());
+                    reclaimedAtCache = table->reclaimedCount;
+                }
+                return pGroup;
+            }
+
+        public:
+            /**
+             * Binds to the group of the given key, the key is copied only if there is no such group yet
+             */
+            GroupView(const GroupTable &table, GroupKeyLookup<Key> lookup) : table(&table), reclaimedAtCache(table.reclaimedCount) {
+                auto itr = table.groups.find(lookup);
+                if (itr != table.groups.end()) {
+                    pGroup = &itr->second.entries;
+                    if constexpr (sharedKeys) {
+                        key = itr->second.viewKey;
+                    } else {
+                        key = itr->first;
+                    }
+                } else if constexpr (sharedKeys) {
+                    key = std::make_shared<const Key>(lookup);
+                } else {
+                    key = lookup;
+                }
+            }
+
+            GroupView() = default;
+
+            auto begin() const {
+                auto entries = group();
+                return entries ? entries->begin() : iterType{};
+            }
+
+            auto end() const {
+                auto entries = group();
+                return entries ? entries->end() : iterType{};
+            }
+        };
+    };
+
+    /**
+     * Returns the key of every placed container by every grouping, keys[g][i] is the key of placed[i] by functionOf(g).
+     * Keys of large batches are computed in parallel, one task per grouping and chunk of containers,
+     * grouping functions must be safe to call from several threads then
+     */
+    template<typename Key, typename Container, typename FunctionOf>
+    std::vector<std::vector<Key>> groupKeys(std::size_t groupings, const FunctionOf &functionOf, std::span<const PlacedContainer<Container>> placed) {
+        std::vector<std::vector<Key>> keys(groupings);
+        if (placed.size() < parallelBatchSize) {
+            for (std::size_t g = 0; g < groupings; ++g) {
+                keys[g].reserve(placed.size());
+                for (auto &p: placed) {
+                    keys[g].push_back(functionOf(g)(*p.container));
+                }
+            }
+            return keys;
+        }
+
+        std::size_t chunks = (placed.size() + parallelBatchSize - 1) / parallelBatchSize;
+        std::vector<std::vector<Key>> chunkKeys(groupings * chunks);
+        parallelFor(chunkKeys.size(), [&](std::size_t task) {
+            auto chunk = placed.subspan(task % chunks * parallelBatchSize).first(
+                    std::min(parallelBatchSize, placed.size() - task % chunks * parallelBatchSize));
+            chunkKeys[task].reserve(chunk.size());
+            for (auto &p: chunk) {
+                chunkKeys[task].push_back(functionOf(task / chunks)(*p.container));
+            }
+        });
+        parallelFor(groupings, [&](std::size_t g) {
+            keys[g].reserve(placed.size());
+            for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+                auto &part = chunkKeys[g * chunks + chunk];
+                std::move(part.begin(), part.end(), std::back_inserter(keys[g]));
+            }
+        });
+        return keys;
+    }
+
+    /**
+     * Returns the given aggregates with the aggregate of the given name added, or replaced if there is one
+     */
+    template<typename Container>
+    std::shared_ptr<const Aggregates<Container>> withAggregate(const std::shared_ptr<const Aggregates<Container>> &aggregates, std::string name,
+                                                               std::function<double(const Container &)> projection) {
+        auto functions = aggregates ? std::make_shared<Aggregates<Container>>(*aggregates) : std::make_shared<Aggregates<Container>>();
+        auto itr = std::find_if(functions->begin(), functions->end(), [&](auto &aggregate) { return aggregate.name == name; });
+        if (itr != functions->end()) {
+            itr->projection = std::move(projection);
+        } else {
+            functions->push_back({std::move(name), std::move(projection)});
+        }
+        return functions;
+    }
+
+    /**
+     * Group index of grouping functions registered at runtime by name
+     */
+    template<typename Container, GroupKeyType Key>
+    class DynamicGroupIndex {
+        X shipX;
+        Y shipY;
+        Height shipHeight;
+        Grouping<Container, Key> groupingFunctions;
+        std::shared_ptr<const Aggregates<Container>> aggregates;
+        std::unordered_map<std::string, GroupTable<Container, Key>, StringHash, std::equal_to<>> groups;
+
+        /**
+         * A grouping function together with its groups, numbered in the order they were registered
+         */
+        struct GroupingIndex {
+            const std::function<Key(const Container &)> *function;
+            GroupTable<Container, Key> *table;
+        };
+        std::vector<GroupingIndex> groupingIndexes;
+
+    public:
+        DynamicGroupIndex(X x, Y y, Height height) : shipX(x), shipY(y), shipHeight(height) {}
+
+        /**
+         * Copies the groups of another index without calling the grouping functions,
+         * locate(entry) gives the container the copy of the entry refers to
+         */
+        template<typename Locate>
+        DynamicGroupIndex(const DynamicGroupIndex &other, Locate locate)
+                : shipX(other.shipX), shipY(other.shipY), shipHeight(other.shipHeight), groupingFunctions(other.groupingFunctions),
+                  aggregates(other.aggregates) {
+            for (auto &groupNameAndFunction: groupingFunctions) {
+                auto[itr, _] = groups.try_emplace(groupNameAndFunction.first, *other.find(groupNameAndFunction.first), locate);
+                groupingIndexes.push_back({&groupNameAndFunction.second, &itr->second});
+            }
+        }
+
+        /**
+         * Copies the groups of another index, the entries keep referring to the same containers
+         */
+        DynamicGroupIndex(const DynamicGroupIndex &other)
+                : DynamicGroupIndex(other, [](const GroupEntry<Container> &entry) -> const Container & { return entry.second; }) {}
+
+        /**
+         * Takes the groups of another index, the groups stay where they are so views of them stay valid
+         */
+        DynamicGroupIndex(DynamicGroupIndex &&) noexcept = default;
+
+        void swap(DynamicGroupIndex &other) noexcept {
+            std::swap(shipX, other.shipX);
+            std::swap(shipY, other.shipY);
+            std::swap(shipHeight, other.shipHeight);
+            groupingFunctions.swap(other.groupingFunctions);
+            aggregates.swap(other.aggregates);
+            groups.swap(other.groups);
+            groupingIndexes.swap(other.groupingIndexes);
+        }
+
+        DynamicGroupIndex &operator=(const DynamicGroupIndex &) = delete;
+
+        /**
+         * Sets the grouping functions and creates their groups, called once before anything is loaded
+         */
+        void registerGroupings(Grouping<Container, Key> functions) {
+            groupingFunctions = std::move(functions);
+            for (auto &groupNameAndFunction: groupingFunctions) {
+                auto[itr, _] = groups.try_emplace(groupNameAndFunction.first, shipX, shipY, shipHeight);
+                itr->second.setAggregates(aggregates);
+                groupingIndexes.push_back({&groupNameAndFunction.second, &itr->second});
+            }
+        }
+
+        /**
+         * Adds an aggregate to every group of every grouping, or replaces the aggregate of the same name.
+         * Containers already loaded are aggregated right away
+         */
+        void registerAggregate(std::string name, std::function<double(const Container &)> projection) {
+            aggregates = withAggregate(aggregates, std::move(name), std::move(projection));
+            for (auto &grouping: groupingIndexes) {
+                grouping.table->setAggregates(aggregates);
+            }
+        }
+
+        /**
+         * Adds container to all relevant groups by it's position
+         */
+        void addContainerToAllGroups(const Container &container, Position pos) {
+            for (auto &grouping: groupingIndexes) {
+                grouping.table->add((*grouping.function)(container), container, pos);
+            }
+        }
+
+        /**
+         * Adds the given containers to all relevant groups, one grouping at a time.
+         * Keys of large batches are computed in parallel, see groupKeys, then every grouping adds its keys in batch order
+         * so the groups come out the same as a serial run. Groupings of large batches are added in parallel too
+         */
+        void addContainersToAllGroups(std::span<const PlacedContainer<Container>> placed) {
+            auto keys = groupKeys<Key>(groupingIndexes.size(), [this](std::size_t g) -> auto & { return *groupingIndexes[g].function; }, placed);
+            if (placed.size() < parallelBatchSize) {
+                for (std::size_t g = 0; g < groupingIndexes.size(); ++g) {
+                    groupingIndexes[g].table->addBatch(keys[g], placed);
+                }
+                return;
+            }
+            // Every grouping has its own table
+            parallelFor(groupingIndexes.size(), [&](std::size_t g) {
+                groupingIndexes[g].table->addBatch(keys[g], placed);
+            });
+        }
+
+        /**
+         * Removes container from all groups by it's position, using the slot back-pointers
+         */
+        void removeContainerFromAllGroups(Position pos) {
+            for (auto &grouping: groupingIndexes) {
+                grouping.table->remove(pos);
+            }
+        }
+
+        /**
+         * Updates all groups with the new position of a moved container, without calling the grouping functions
+         */
+        void relocateContainerInAllGroups(Position from, Position to, const Container &container) {
+            for (auto &grouping: groupingIndexes) {
+                grouping.table->relocate(from, to, container);
+            }
+        }
+
+        /**
+         * Returns the groups of the given grouping, or nullptr if there is no such grouping
+         */
+        const GroupTable<Container, Key> *find(std::string_view groupingName) const {
+            auto itr = groups.find(groupingName);
+            return itr != groups.end() ? &itr->second : nullptr;
+        }
+    };
+
+    /**
+     * Group index shared between a ship and its clones the way SharedCargoArena shares stacks.
+     * Every bay has its own group table per grouping, a change made while the tables of its bay are shared copies only them.
+     * A group spans the tables of all bays, its views and stats go over the bays
+     */
+    template<typename Container, GroupKeyType Key>
+    class SharedGroupIndex {
+        using Table = GroupTable<Container, Key>;
+        using Bay = std::vector<Table>; // Table of every grouping, in registration order
+        using Bays = std::vector<std::shared_ptr<Bay>>;
+
+        /**
+         * Grouping functions by name and by registration order, set once before anything is loaded
+         */
+        struct Functions {
+            std::unordered_map<std::string, std::size_t, StringHash, std::equal_to<>> numbers;
+            std::vector<std::function<Key(const Container &)>> byNumber;
+        };
+
+        X shipX;
+        Y shipY;
+        Height shipHeight;
+        std::shared_ptr<const Functions> functions = std::make_shared<const Functions>();
+        std::shared_ptr<const Aggregates<Container>> aggregates;
+        std::shared_ptr<Bays> bays;
+
+        std::size_t groupingCount() const {
+            return functions ? functions->byNumber.size() : 0;
+        }
+
+        int bayCount() const {
+            return bays ? int(bays->size()) : 0;
+        }
+
+        const Table &tableOf(int x, std::size_t grouping) const {
+            return (*(*bays)[x])[grouping];
+        }
+
+        /**
+         * Gives this index its own copy of the tables of the given bay if they're shared with another index
+         */
+        Bay &writableBay(int x) {
+            if (bays.use_count() > 1) {
+                bays = std::make_shared<Bays>(*bays);
+            }
+            auto &bay = (*bays)[x];
+            if (bay.use_count() > 1) {
+                bay = std::make_shared<Bay>(*bay);
+            }
+            return *bay;
+        }
+
+    public:
+        /**
+         * View of the containers of a group, bay by bay.
+         * Bound to the index and the group key, so it sees later changes of the ship without creating the group
+         */
+        class GroupView : public std::ranges::view_interface<GroupView> {
+            const SharedGroupIndex *index = nullptr;
+            std::size_t grouping = 0;
+            Key key{};
+
+        public:
+            class Iterator {
+                const SharedGroupIndex *index = nullptr;
+                std::size_t grouping = 0;
+                const Key *key = nullptr;
+                int bay = 0;
+                const GroupEntries<Container> *entries = nullptr; // Entries of the group in the current bay
+                std::size_t entry = 0;
+
+                /**
+                 * Moves to the first entry of the group in the given bay or in a later one
+                 */
+                void findBay(int from) {
+                    entry = 0;
+                    for (bay = from; bay < index->bayCount(); ++bay) {
+                        if ((entries = index->tableOf(bay, grouping).find(*key))) {
+                            return;
+                        }
+                    }
+                    entries = nullptr;
+                }
+
+            public:
+                using value_type = GroupEntry<Container>;
+                using difference_type = std::ptrdiff_t;
+                using iterator_concept = std::forward_iterator_tag;
+
+                Iterator(const SharedGroupIndex &index, std::size_t grouping, const Key &key, int bay)
+                        : index(&index), grouping(grouping), key(&key) {
+                    findBay(bay);
+                }
+
+                Iterator() = default;
+
+                Iterator &operator++() {
+                    if (++entry == entries->size()) {
+                        findBay(bay + 1);
+                    }
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    auto copy = *this;
+                    ++*this;
+                    return copy;
+                }
+
+                const GroupEntry<Container> &operator*() const {
+                    return (*entries)[entry];
+                }
+
+                bool operator==(const Iterator &other) const {
+                    return bay == other.bay && entry == other.entry;
+                }
+            };
+
+            GroupView(const SharedGroupIndex &index, std::size_t grouping, GroupKeyLookup<Key> key)
+                    : index(&index), grouping(grouping), key(key) {}
+
+            GroupView() = default;
+
+            Iterator begin() const {
+                return index ? Iterator(*index, grouping, key, 0) : Iterator();
+            }
+
+            Iterator end() const {
+                return index ? Iterator(*index, grouping, key, index->bayCount()) : Iterator();
+            }
+        };
+
+        /**
+         * Groups of one grouping over all bays
+         */
+        class GroupingTables {
+            const SharedGroupIndex *index;
+            std::size_t grouping;
+
+        public:
+            GroupingTables(const SharedGroupIndex &index, std::size_t grouping) : index(&index), grouping(grouping) {}
+
+            GroupView view(GroupKeyLookup<Key> key) const {
+                return GroupView(*index, grouping, key);
+            }
+
+            /**
+             * Returns the count and aggregates of the given group in O(bays * number of aggregates)
+             */
+            GroupStats<Container> stats(GroupKeyLookup<Key> key) const {
+                GroupStats<Container> total(index->aggregates, {}, 0);
+                for (int x = 0; x < index->bayCount(); ++x) {
+                    total.merge(index->tableOf(x, grouping).stats(key));
+                }
+                return total;
+            }
+
+            void markGroup(GroupKeyLookup<Key> key, std::span<std::uint64_t> bits) const {
+                for (int x = 0; x < index->bayCount(); ++x) {
+                    index->tableOf(x, grouping).markGroup(key, bits);
+                }
+            }
+        };
+
+        SharedGroupIndex(X x, Y y, Height height) : shipX(x), shipY(y), shipHeight(height), bays(std::make_shared<Bays>(x)) {
+            for (auto &bay: *bays) {
+                bay = std::make_shared<Bay>();
+            }
+        }
+
+        /**
+         * Shares the tables of another ship, containers of a shared arena keep their addresses when the arena is copied
+         */
+        template<typename Locate>
+        SharedGroupIndex(const SharedGroupIndex &other, Locate &&) : SharedGroupIndex(other) {}
+
+        SharedGroupIndex(const SharedGroupIndex &) = default;
+
+        /**
+         * Takes the tables of another index, which is left with no bays
+         */
+        SharedGroupIndex(SharedGroupIndex &&) noexcept = default;
+
+        void swap(SharedGroupIndex &other) noexcept {
+            std::swap(shipX, other.shipX);
+            std::swap(shipY, other.shipY);
+            std::swap(shipHeight, other.shipHeight);
+            functions.swap(other.functions);
+            aggregates.swap(other.aggregates);
+            bays.swap(other.bays);
+        }
+
+        /**
+         * Sets the grouping functions and creates their tables in every bay, called once before anything is loaded
+         */
+        void registerGroupings(Grouping<Container, Key> groupingFunctions) {
+            auto registered = std::make_shared<Functions>();
+            for (auto &[name, function]: groupingFunctions) {
+                registered->numbers.emplace(name, registered->byNumber.size());
+                registered->byNumber.push_back(std::move(function));
+            }
+            functions = std::move(registered);
+            for (int x = 0; x < bayCount(); ++x) {
+                Bay &bay = writableBay(x);
+                bay.clear();
+                for (std::size_t grouping = 0; grouping < groupingCount(); ++grouping) {
+                    bay.emplace_back(1, shipY, shipHeight, x).setAggregates(aggregates);
+                }
+            }
+        }
+
+        /**
+         * Adds an aggregate to every group, or replaces the aggregate of the same name. Gives this index its own copy of every bay
+         */
+        void registerAggregate(std::string name, std::function<double(const Container &)> projection) {
+            aggregates = withAggregate(aggregates, std::move(name), std::move(projection));
+            for (int x = 0; x < bayCount(); ++x) {
+                for (Table &table: writableBay(x)) {
+                    table.setAggregates(aggregates);
+                }
+            }
+        }
+
+        void addContainerToAllGroups(const Container &container, Position pos) {
+            if (groupingCount() == 0) {
+                return;
+            }
+            Bay &bay = writableBay(std::get<0>(pos));
+            for (std::size_t grouping = 0; grouping < groupingCount(); ++grouping) {
+                bay[grouping].add(functions->byNumber[grouping](container), container, pos);
+            }
+        }
+
+        /**
+         * Adds the given containers to all relevant groups, keys are computed as in groupKeys and every bay is changed once
+         */
+        void addContainersToAllGroups(std::span<const PlacedContainer<Container>> placed) {
+            if (groupingCount() == 0) {
+                return;
+            }
+            auto keys = groupKeys<Key>(groupingCount(), [this](std::size_t g) -> auto & { return functions->byNumber[g]; }, placed);
+            // Containers of a bay are added together, in batch order so the groups come out the same as a serial run
+            std::vector<std::size_t> order(placed.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+                return std::get<0>(placed[a].position) < std::get<0>(placed[b].position);
+            });
+            std::vector<PlacedContainer<Container>> bayPlaced;
+            std::vector<Key> bayKeys;
+            for (std::size_t first = 0, last; first < order.size(); first = last) {
+                int x = std::get<0>(placed[order[first]].position);
+                for (last = first; last < order.size() && std::get<0>(placed[order[last]].position) == x; ++last) {}
+                Bay &bay = writableBay(x);
+                bayPlaced.clear();
+                for (std::size_t i = first; i < last; ++i) {
+                    bayPlaced.push_back(placed[order[i]]);
+                }
+                for (std::size_t grouping = 0; grouping < groupingCount(); ++grouping) {
+                    bayKeys.clear();
+                    for (std::size_t i = first; i < last; ++i) {
+                        bayKeys.push_back(std::move(keys[grouping][order[i]]));
+                    }
+                    bay[grouping].addBatch(bayKeys, bayPlaced);
+                }
+            }
+        }
+
+        void removeContainerFromAllGroups(Position pos) {
+            if (groupingCount() == 0) {
+                return;
+            }
+            for (Table &table: writableBay(std::get<0>(pos))) {
+                table.remove(pos);
+            }
+        }
+
+        /**
+         * Updates all groups with the new position of a moved container without calling the grouping functions,
+         * a container moved to another bay leaves the tables of its old bay for those of the new one
+         */
+        void relocateContainerInAllGroups(Position from, Position to, const Container &container) {
+            if (groupingCount() == 0) {
+                return;
+            }
+            Bay &source = writableBay(std::get<0>(from));
+            if (std::get<0>(from) == std::get<0>(to)) {
+                for (Table &table: source) {
+                    table.relocate(from, to, container);
+                }
+                return;
+            }
+            Bay &target = writableBay(std::get<0>(to));
+            for (std::size_t grouping = 0; grouping < groupingCount(); ++grouping) {
+                Key key = source[grouping].keyOf(from);
+                // The old entry is pointed to the container at its new place before it's removed, the old place may be gone
+                source[grouping].relocate(from, from, container);
+                source[grouping].remove(from);
+                target[grouping].add(key, container, to);
+            }
+        }
+
+        /**
+         * Returns the groups of the given grouping, or nothing if there is no such grouping
+         */
+        std::optional<GroupingTables> find(std::string_view groupingName) const {
+            if (!functions) {
+                return std::nullopt;
+            }
+            auto itr = functions->numbers.find(groupingName);
+            if (itr == functions->numbers.end()) {
+                return std::nullopt;
+            }
+            return GroupingTables(*this, itr->second);
+        }
+    };
+
+    /**
+     * Group index whose groups are split into shards by key, every shard locked separately.
+     * Callers changing a slot must hold the lock of the slot's stack, the index locks the shards itself.
+     * The shards of a grouping share one membership per slot, an entry is written under the lock of the shard holding the slot.
+     * Grouping functions are called outside of the shard locks
+     */
+    template<typename Container, typename Key, std::size_t ShardCount = 16>
+    class ShardedGroupIndex {
+        using Table = GroupTable<Container, Key>;
+
+        struct Shard {
+            std::mutex lock;
+            Table table;
+
+            Shard(typename Table::Memberships &memberships, Y y, Height height) : table(memberships, y, height) {}
+        };
+
+        /**
+         * Grouping function together with its shards
+         */
+        struct ShardedGrouping {
+            std::function<Key(const Container &)> function;
+            typename Table::Memberships memberships; // Entry of every slot, shared by the shards and never resized
+            std::vector<std::unique_ptr<Shard>> shards;
+            std::vector<std::uint8_t> slotShards; // Shard holding the entry of each slot, guarded by the lock of the slot's stack
+        };
+
+        X shipX;
+        Y shipY;
+        Height shipHeight;
+        std::unordered_map<std::string, ShardedGrouping, StringHash, std::equal_to<>> groupings;
+        std::shared_ptr<const GroupingLookup<Container, Key>> functions = std::make_shared<GroupingLookup<Container, Key>>();
+
+        static_assert(ShardCount <= 256, "shard of a slot is kept in one byte");
+
+        static std::size_t shardOf(GroupKeyLookup<Key> key) {
+            return GroupKeyHash<Key>{}(key) % ShardCount;
+        }
+
+        std::size_t slotIndex(Position pos) const {
+            return (std::size_t(std::get<0>(pos)) * shipY + std::get<1>(pos)) * shipHeight + std::get<2>(pos);
+        }
+
+    public:
+        ShardedGroupIndex(X x, Y y, Height height) : shipX(x), shipY(y), shipHeight(height) {}
+
+        ShardedGroupIndex(const ShardedGroupIndex &) = delete;
+
+        ShardedGroupIndex &operator=(const ShardedGroupIndex &) = delete;
+
+        /**
+         * Sets the grouping functions and creates their shards, called once before anything is loaded
+         */
+        void registerGroupings(Grouping<Container, Key> groupingFunctions) {
+            functions = std::make_shared<GroupingLookup<Container, Key>>(groupingFunctions.begin(), groupingFunctions.end());
+            for (auto &[name, function]: groupingFunctions) {
+                ShardedGrouping &grouping = groupings[name];
+                grouping.function = std::move(function);
+                grouping.memberships.resize(std::size_t(shipX) * shipY * shipHeight);
+                grouping.slotShards.resize(grouping.memberships.size());
+                for (std::size_t shard = 0; shard < ShardCount; ++shard) {
+                    grouping.shards.push_back(std::make_unique<Shard>(grouping.memberships, shipY, shipHeight));
+                }
+            }
+        }
+
+        void addContainerToAllGroups(const Container &container, Position pos) {
+            for (auto &[_, grouping]: groupings) {
+                Key key = grouping.function(container);
+                std::size_t shard = shardOf(key);
+                grouping.slotShards[slotIndex(pos)] = std::uint8_t(shard);
+                std::lock_guard guard(grouping.shards[shard]->lock);
+                grouping.shards[shard]->table.add(key, container, pos);
+            }
+        }
+
+        /**
+         * Adds the given containers to all relevant groups, taking every shard lock once per grouping.
+         * All keys are computed before any group changes, so a throwing grouping function leaves the groups as they were
+         */
+        void addContainersToAllGroups(std::span<const PlacedContainer<Container>> placed) {
+            std::vector<std::vector<Key>> groupingKeys;
+            groupingKeys.reserve(groupings.size());
+            for (auto &[_, grouping]: groupings) {
+                auto &groupingKey = groupingKeys.emplace_back();
+                groupingKey.reserve(placed.size());
+                for (auto &p: placed) {
+                    groupingKey.push_back(grouping.function(*p.container));
+                }
+            }
+
+            std::array<std::vector<Key>, ShardCount> keys;
+            std::array<std::vector<PlacedContainer<Container>>, ShardCount> shardPlaced;
+            auto groupingKey = groupingKeys.begin();
+            for (auto &[_, grouping]: groupings) {
+                for (std::size_t shard = 0; shard < ShardCount; ++shard) {
+                    keys[shard].clear();
+                    shardPlaced[shard].clear();
+                }
+                for (std::size_t i = 0; i < placed.size(); ++i) {
+                    std::size_t shard = shardOf((*groupingKey)[i]);
+                    grouping.slotShards[slotIndex(placed[i].position)] = std::uint8_t(shard);
+                    keys[shard].push_back(std::move((*groupingKey)[i]));
+                    shardPlaced[shard].push_back(placed[i]);
+                }
+                ++groupingKey;
+                for (std::size_t shard = 0; shard < ShardCount; ++shard) {
+                    if (!keys[shard].empty()) {
+                        std::lock_guard guard(grouping.shards[shard]->lock);
+                        grouping.shards[shard]->table.addBatch(keys[shard], shardPlaced[shard]);
+                    }
+                }
+            }
+        }
+
+        void removeContainerFromAllGroups(Position pos) {
+            for (auto &[_, grouping]: groupings) {
+                Shard &shard = *grouping.shards[grouping.slotShards[slotIndex(pos)]];
+                std::lock_guard guard(shard.lock);
+                shard.table.remove(pos);
+            }
+        }
+
+        /**
+         * Updates all groups with the new position of a moved container, caller holds the locks of both stacks
+         */
+        void relocateContainerInAllGroups(Position from, Position to, const Container &container) {
+            for (auto &[_, grouping]: groupings) {
+                std::uint8_t shardIndex = grouping.slotShards[slotIndex(from)];
+                grouping.slotShards[slotIndex(to)] = shardIndex;
+                Shard &shard = *grouping.shards[shardIndex];
+                std::lock_guard guard(shard.lock);
+                shard.table.relocate(from, to, container);
+            }
+        }
+
+        /**
+         * Returns the grouping functions, shared so snapshots can outlive the index
+         */
+        std::shared_ptr<const GroupingLookup<Container, Key>> groupingFunctions() const {
+            return functions;
+        }
+
+        /**
+         * Returns the shard of the given grouping holding the given group, or nullptr if there is no such grouping
+         */
+        const GroupTable<Container, Key> *find(std::string_view groupingName, GroupKeyLookup<Key> groupName) const {
+            auto itr = groupings.find(groupingName);
+            return itr != groupings.end() ? &itr->second.shards[shardOf(groupName)]->table : nullptr;
+        }
+    };
+
+    /**
+     * Grouping function known at compile time, Function is a default constructible functor
+     */
+    template<FixedString Name, typename Function>
+    struct NamedGrouping {
+        static constexpr auto name = Name;
+        using GroupingFunction = Function;
+    };
+
+    /**
+     * Group index of grouping functions given as template parameters.
+     * Each grouping gets a compile time slot, so functions are called directly and groupings are resolved without hashing
+     */
+    template<typename Container, typename... Groupings>
+    class StaticGroupIndex {
+        template<typename G>
+        using KeyOf = std::remove_cvref_t<std::invoke_result_t<const typename G::GroupingFunction &, const Container &>>;
+
+        std::tuple<typename Groupings::GroupingFunction...> groupingFunctions;
+        std::tuple<GroupTable<Container, KeyOf<Groupings>>...> groups;
+
+        /**
+         * Calls f with the index of every grouping, unrolled at compile time
+         */
+        template<typename F>
+        static void forEachGrouping(F &&f) {
+            [&]<std::size_t... I>(std::index_sequence<I...>) {
+                (f(std::integral_constant<std::size_t, I>{}), ...);
+            }(std::index_sequence_for<Groupings...>{});
+        }
+
+    public:
+        /**
+         * Returns the slot of the grouping with the given name
+         */
+        template<FixedString Name>
+        static constexpr std::size_t indexOf() {
+            constexpr std::string_view names[] = {Groupings::name.view()..., {}};
+            std::size_t index = std::find(names, names + sizeof...(Groupings), Name.view()) - names;
+            return index;
+        }
+
+        template<FixedString Name>
+        using KeyOfName = KeyOf<std::tuple_element_t<indexOf<Name>(), std::tuple<Groupings...>>>;
+
+        StaticGroupIndex(X x, Y y, Height height) : groups(GroupTable<Container, KeyOf<Groupings>>(x, y, height)...) {}
+
+        // Views refer to the group tables stored inside the index, so it stays where it is
+        StaticGroupIndex(const StaticGroupIndex &) = delete;
+
+        StaticGroupIndex &operator=(const StaticGroupIndex &) = delete;
+
+        void addContainerToAllGroups(const Container &container, Position pos) {
+            forEachGrouping([&](auto g) {
+                std::get<g>(groups).add(std::get<g>(groupingFunctions)(container), container, pos);
+            });
+        }
+
+        /**
+         * Adds the given containers to all groups, large batches run one task per grouping.
+         * All keys are computed before any group changes, so a throwing grouping function leaves the groups as they were
+         */
+        void addContainersToAllGroups(std::span<const PlacedContainer<Container>> placed) {
+            std::tuple<std::vector<KeyOf<Groupings>>...> keys;
+            std::array<std::function<void()>, sizeof...(Groupings)> computeKeys, addKeys;
+            forEachGrouping([&](auto g) {
+                computeKeys[g] = [this, placed, g, &keys] {
+                    auto &groupingKeys = std::get<g>(keys);
+                    groupingKeys.reserve(placed.size());
+                    for (auto &p: placed) {
+                        groupingKeys.push_back(std::get<g>(groupingFunctions)(*p.container));
+                    }
+                };
+                addKeys[g] = [this, placed, g, &keys] {
+                    std::get<g>(groups).addBatch(std::get<g>(keys), placed);
+                };
+            });
+            auto run = [&](auto &tasks) {
+                if (placed.size() < parallelBatchSize) {
+                    for (auto &task: tasks) {
+                        task();
+                    }
+                } else {
+                    parallelFor(tasks.size(), [&](std::size_t g) { tasks[g](); });
+                }
+            };
+            run(computeKeys);
+            run(addKeys);
+        }
+
+        void removeContainerFromAllGroups(Position pos) {
+            forEachGrouping([&](auto g) {
+                std::get<g>(groups).remove(pos);
+            });
+        }
+
+        void relocateContainerInAllGroups(Position from, Position to, const Container &container) {
+            forEachGrouping([&](auto g) {
+                std::get<g>(groups).relocate(from, to, container);
+            });
+        }
+
+        template<FixedString Name>
+        const GroupTable<Container, KeyOfName<Name>> &find() const {
+            static_assert(indexOf<Name>() < sizeof...(Groupings), "no grouping with this name");
+            return std::get<indexOf<Name>()>(groups);
+        }
+    };
+
+    /**
+     * Ship logic shared by all ship variants, GroupIndex keeps the groups up to date with load and unload
+     */
+    template<typename Container, typename GroupIndex, typename Arena = CargoArena<Container>>
+    class BasicShip {
+    public: // Forward Decelerations
+
+        class ShipCargoIterator;
+
+        class PositionedCargoIterator;
+
+        class CargoRange;
+
+        class PositionView;
+
+        class QueryView;
+
+        class StackContainers;
+
+    protected:
+        // Ships over a copyable copy-on-write arena are cloned in O(1), so they keep no index a clone would have to copy
+        static constexpr bool cheapClones = Arena::copyOnWrite && std::is_copy_constructible_v<Arena>;
+        using Fixed = FixedDimensions<Arena>;
+
+        Arena containers;
+        GroupIndex groupIndex;
+        std::conditional_t<cheapClones, std::monostate, RegionCounts<Arena::concurrentWrites, Fixed::x, Fixed::y>> regionCounts;
+        // Stacks of a concurrent arena change under different locks, so they don't share these, and a clone of a copy-on-write ship
+        // would have to copy them. Neither keeps them, so they have no loadAuto or layer views
+        std::conditional_t<Arena::copyOnWrite, std::monostate, StackSpaceTree<Fixed::x * Fixed::y>> freeSpace;
+        using Layers = LayerIndex<Fixed::x * Fixed::y, Fixed::height>;
+        std::conditional_t<Arena::copyOnWrite, std::monostate, Layers> layers;
+
+        /**
+         * Builds an index member, or nothing if the ship doesn't keep it
+         */
+        template<typename Index, typename... Args>
+        static Index makeIndex(Args... args) {
+            if constexpr (std::is_same_v<Index, std::monostate>) {
+                return {};
+            } else {
+                return Index(args...);
+            }
+        }
+
+    public:
+        BasicShip(X x, Y y, Height height) noexcept
+                : containers(x, y, height), groupIndex(x, y, height), regionCounts(makeIndex<decltype(regionCounts)>(x, y, height)),
+                  freeSpace(makeIndex<decltype(freeSpace)>(x * y, height)), layers(makeIndex<decltype(layers)>(x * y, height)) {}
+
+        BasicShip(X x, Y y, Height max_height, const std::vector<Position> &restrictions) noexcept(false)
+                : BasicShip(x, y, max_height) {
+            validateRestrictions(restrictions);
+            applyRestrictions(restrictions);
+        }
+
+        /**
+         * Copies the cargo of another ship and rebuilds the groups over the copies in one pass, without calling the grouping functions
+         */
+        BasicShip(const BasicShip &other) requires std::is_copy_constructible_v<Arena> && std::is_copy_constructible_v<GroupIndex>
+                : containers(other.containers), groupIndex(other.groupIndex, [this](const GroupEntry<Container> &entry) -> const Container & {
+                    auto[x, y, height] = entry.first;
+                    return containers.at(stackIndex(x, y), height);
+                }), regionCounts(other.regionCounts), freeSpace(other.freeSpace), layers(other.layers) {}
+
+        /**
+         * Takes the cargo and groups of another ship in O(1), which is left with no stacks.
+         * Cargo and groups stay where they are, so views taken from the other ship now show this ship
+         */
+        BasicShip(BasicShip &&) noexcept = default;
+
+        /**
+         * Copy or move assignment, the previous cargo of this ship is destroyed with the argument
+         */
+        BasicShip &operator=(BasicShip other) noexcept requires std::is_move_constructible_v<Arena> && std::is_move_constructible_v<GroupIndex> {
+            containers.swap(other.containers);
+            groupIndex.swap(other.groupIndex);
+            if constexpr (!cheapClones) {
+                regionCounts.swap(other.regionCounts);
+            }
+            std::swap(freeSpace, other.freeSpace);
+            std::swap(layers, other.layers);
+            return *this;
+        }
+
+    protected:
+        int shipX() const {
+            return containers.sizeX();
+        }
+
+        int shipY() const {
+            return containers.sizeY();
+        }
+
+        int shipHeight() const {
+            return containers.sizeHeight();
+        }
+
+        /**
+         * Returns the matches of the given query, findGrouping(name) gives the group table of a grouping or nullptr
+         */
+        template<typename Key, typename FindGrouping>
+        QueryView runQuery(const GroupQuery<Key> &query, const FindGrouping &findGrouping) const {
+            std::size_t slots = std::size_t(containers.size()) * shipHeight();
+            std::vector<std::uint64_t> occupied((slots + 63) / 64);
+            for (int stack = containers.nextOccupied(0); stack < containers.size(); stack = containers.nextOccupied(stack + 1)) {
+                std::size_t first = std::size_t(stack) * shipHeight(), last = first + containers.height(stack);
+                for (std::size_t slot = first; slot < last; ++slot) {
+                    occupied[slot / 64] |= std::uint64_t(1) << (slot % 64);
+                }
+            }
+            auto markGroup = [&](const std::string &grouping, const Key &key, std::span<std::uint64_t> bits) {
+                if (auto table = findGrouping(grouping)) {
+                    table->markGroup(key, bits);
+                }
+            };
+            return QueryView(containers.handle(), std::make_shared<const std::vector<std::uint64_t>>(query.evaluate(markGroup, occupied)));
+        }
+
+        /**
+         * Brings the region counts, the free space tree and the layers up to date after the height of a stack changed by delta
+         */
+        void stackChanged(int stack, int delta) {
+            if constexpr (!cheapClones) {
+                regionCounts.add(stack / shipY(), stack % shipY(), delta);
+            }
+            if constexpr (!Arena::copyOnWrite) {
+                freeSpace.update(stack, containers.height(stack), containers.spacesLeft(stack));
+                if (delta > 0) {
+                    layers.add(stack, containers.height(stack) - 1);
+                } else {
+                    layers.remove(stack, containers.height(stack));
+                }
+            }
+        }
+
+        /**
+         * Sets the capacity of every restricted stack, restrictions are expected to be valid
+         */
+        void applyRestrictions(std::span<const Position> restrictions) {
+            for (Position res : restrictions) {
+                int resX = std::get<0>(res), resY = std::get<1>(res), resHeight = std::get<2>(res);
+                containers.restrict(stackIndex(resX, resY), resHeight);
+                if constexpr (!Arena::copyOnWrite) {
+                    freeSpace.update(stackIndex(resX, resY), 0, resHeight);
+                }
+            }
+            if constexpr (!cheapClones) {
+                regionCounts.setCapacities([this](int x, int y) { return containers.spacesLeft(stackIndex(x, y)) + containers.height(stackIndex(x, y)); });
+            }
+        }
+
+        /**
+         * Returns the sum of stackValue(stack) over stacks of bays x0..x1 and rows y0..y1, region counts of ships without them
+         */
+        template<typename StackValue>
+        int sumRegion(X x0, Y y0, X x1, Y y1, const StackValue &stackValue) const {
+            int sum = 0;
+            for (int x = x0; x <= x1; ++x) {
+                for (int stack = stackIndex(x, y0); stack <= stackIndex(x, y1); ++stack) {
+                    sum += stackValue(stack);
+                }
+            }
+            return sum;
+        }
+
+        /**
+         * Validates the given restrictions
+         */
+        void validateRestrictions(const std::vector<Position> &restrictions) noexcept(false) {
+            std::set<std::tuple<int, int>> xyHistory;
+
+            for (Position res : restrictions) {
+                int x = std::get<0>(res), y = std::get<1>(res), height = std::get<2>(res);
+                validateXY(x, y);
+                if (height < 0 || height >= shipHeight()) {
+                    throw BadShipOperationException(
+                            "received position with bad height value. Height value is" + std::to_string(height) + ", ship X is " + std::to_string(shipHeight()));
+                }
+                if (xyHistory.find({x, y}) != xyHistory.end()) {
+                    std::string msg = "received duplicate restriction for X,Y : (" + std::to_string(x) + ", " +
+                                      std::to_string(y) + ")";
+                    throw BadShipOperationException(msg);
+                }
+
+                xyHistory.insert({x, y});
+            }
+        }
+
+        /**
+         * Returns the error of an illegal (x, y), or nothing if it's legal
+         */
+        std::optional<ShipError> checkXY(int x, int y) const noexcept {
+            if (x < 0 || x >= shipX())
+                return ShipError{ShipErrorCode::BadX, x, y, shipX()};
+
+            if (y < 0 || y >= shipY())
+                return ShipError{ShipErrorCode::BadY, x, y, shipY()};
+
+            return std::nullopt;
+        }
+
+        /**
+         * Validates (x, y) are legal
+         */
+        void validateXY(int x, int y) const noexcept(false) {
+            if (auto error = checkXY(x, y))
+                throw BadShipOperationException(*error);
+        }
+
+        /**
+         * Returns the value of the given result, or throws its error
+         */
+        template<typename T>
+        static T valueOrThrow(ShipResult<T> &&result) noexcept(false) {
+            if (!result) {
+                throw BadShipOperationException(result.error());
+            }
+            if constexpr (!std::is_void_v<T>) {
+                return std::move(result.value());
+            }
+        }
+
+        ContainerId topId(int stack) const {
+            return containers.idAt(stack, containers.height(stack) - 1);
+        }
+
+        /**
+         * Returns the index of the (x, y) stack in the cargo arena
+         */
+        int stackIndex(int x, int y) const {
+            return x * shipY() + y;
+        }
+
+        /**
+         * Gives this ship its own copy of the given stack before it's changed, if the arena shares stacks with clones.
+         * Group entries of the copied containers are pointed to the copies
+         */
+        void prepareWrite(int stack) {
+            if constexpr (Arena::copyOnWrite) {
+                if (containers.detach(stack)) {
+                    X x{stack / shipY()};
+                    Y y{stack % shipY()};
+                    for (int height = 0; height < containers.height(stack); ++height) {
+                        Position pos{x, y, Height{height}};
+                        groupIndex.relocateContainerInAllGroups(pos, pos, containers.at(stack, height));
+                    }
+                }
+            }
+        }
+
+    public:
+
+        /**
+         * Loads container to the given position if the position is legal and there is free space in it.
+         * Returns the id of the loaded container
+         */
+        ContainerId load(X x, Y y, const Container &c) noexcept(false) {
+            return valueOrThrow(tryLoad(x, y, c));
+        }
+
+        /**
+         * Loads container to the given position, moving it into the ship. Returns the id of the loaded container
+         */
+        ContainerId load(X x, Y y, Container &&c) noexcept(false) {
+            return valueOrThrow(tryLoad(x, y, std::move(c)));
+        }
+
+        /**
+         * Constructs container from the given arguments directly in its slot at the given position,
+         * if the position is legal and there is free space in it
+         */
+        template<typename... Args>
+        const Container &emplace(X x, Y y, Args &&... args) noexcept(false) {
+            return *valueOrThrow(tryEmplace(x, y, std::forward<Args>(args)...));
+        }
+
+        /**
+         * Loads container to the given position and returns its id, or returns why it can't be loaded
+         */
+        ShipResult<ContainerId> tryLoad(X x, Y y, const Container &c) {
+            auto result = tryEmplace(x, y, c);
+            return result ? ShipResult<ContainerId>(topId(stackIndex(x, y))) : result.error();
+        }
+
+        /**
+         * Loads container to the given position, moving it into the ship, and returns its id.
+         * Returns why it can't be loaded on failure, the container is left untouched then so it can be tried elsewhere
+         */
+        ShipResult<ContainerId> tryLoad(X x, Y y, Container &&c) {
+            auto result = tryEmplace(x, y, std::move(c));
+            return result ? ShipResult<ContainerId>(topId(stackIndex(x, y))) : result.error();
+        }
+
+        /**
+         * Constructs container from the given arguments in its slot at the given position and returns a pointer to it,
+         * or returns why it can't be loaded
+         */
+        template<typename... Args>
+        ShipResult<const Container *> tryEmplace(X x, Y y, Args &&... args) {
+            if (auto error = checkXY(x, y)) {
+                return *error;
+            }
+            int stack = stackIndex(x, y);
+            if (containers.spacesLeft(stack) == 0) {
+                return ShipError{ShipErrorCode::NoSpaceToLoad, x, y};
+            }
+
+            prepareWrite(stack);
+            auto &topContainer = containers.emplace(stack, std::forward<Args>(args)...);
+            stackChanged(stack, 1);
+            int height = containers.height(stack) - 1;
+            groupIndex.addContainerToAllGroups(topContainer, {X{x}, Y{y}, Height{height}});
+            return &topContainer;
+        }
+
+        /**
+         * Loads container on the stack the given policy picks in O(log stacks) and returns its position.
+         * Throws if the ship is full
+         */
+        Position loadAuto(Container c, PlacementPolicy policy = PlacementPolicy::FirstFit) noexcept(false) requires (!Arena::copyOnWrite) {
+            return valueOrThrow(tryLoadAuto(std::move(c), policy));
+        }
+
+        /**
+         * Loads container on the stack the given policy picks and returns its position, or returns why it can't be loaded
+         */
+        ShipResult<Position> tryLoadAuto(Container c, PlacementPolicy policy = PlacementPolicy::FirstFit) requires (!Arena::copyOnWrite) {
+            auto stack = freeSpace.find(policy);
+            if (!stack) {
+                return ShipError{ShipErrorCode::NoSpaceOnShip, 0, 0};
+            }
+            X x{*stack / shipY()};
+            Y y{*stack % shipY()};
+            if (auto loaded = tryEmplace(x, y, std::move(c)); !loaded) {
+                return loaded.error();
+            }
+            return Position{x, y, Height{containers.height(*stack) - 1}};
+        }
+
+        /**
+         * Loads all the given containers, or none of them if any position is illegal or hasn't enough space for its share of the batch.
+         * Containers are moved out of the batch and loaded stack by stack, in batch order within each stack.
+         * If a container can't be moved in or a grouping function throws, the containers already loaded are moved back to the batch
+         */
+        void loadBatch(std::span<std::tuple<X, Y, Container>> batch) noexcept(false) {
+            std::vector<std::uint32_t> order(batch.size());
+            for (std::uint32_t i = 0; i < batch.size(); ++i) {
+                validateXY(std::get<0>(batch[i]), std::get<1>(batch[i]));
+                order[i] = i;
+            }
+
+            auto stackOf = [&](std::uint32_t i) { return stackIndex(std::get<0>(batch[i]), std::get<1>(batch[i])); };
+            std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return stackOf(a) < stackOf(b); });
+
+            // Check the capacity of every stack against its share of the batch before loading anything
+            for (std::size_t first = 0, last; first < order.size(); first = last) {
+                for (last = first + 1; last < order.size() && stackOf(order[last]) == stackOf(order[first]); ++last);
+                X x = std::get<0>(batch[order[first]]);
+                Y y = std::get<1>(batch[order[first]]);
+                if (containers.spacesLeft(stackOf(order[first])) < int(last - first)) {
+                    throw BadShipOperationException(ShipError{ShipErrorCode::NoSpaceForBatch, x, y});
+                }
+            }
+
+            std::vector<PlacedContainer<Container>> placed;
+            placed.reserve(batch.size());
+            try {
+                for (std::uint32_t i: order) {
+                    auto &[x, y, container] = batch[i];
+                    int stack = stackIndex(x, y);
+                    prepareWrite(stack);
+                    auto &loaded = containers.emplace(stack, std::move(container));
+                    stackChanged(stack, 1);
+                    placed.push_back({&loaded, {x, y, Height{containers.height(stack) - 1}}});
+                }
+                // Group indexes compute every key before changing any group, so on failure no group has the batch
+                groupIndex.addContainersToAllGroups(placed);
+            } catch (...) {
+                // Every placed container is on top of its stack when the ones placed after it are gone
+                for (std::size_t i = placed.size(); i-- > 0;) {
+                    int stack = stackOf(order[i]);
+                    std::get<2>(batch[order[i]]) = containers.pop(stack);
+                    stackChanged(stack, -1);
+                }
+                throw;
+            }
+        }
+
+        /**
+         * Unloads container from given position if the position is legal and there is at least one container there.
+         * The container is moved out of the ship
+         */
+        Container unload(X x, Y y) noexcept(false) {
+            return valueOrThrow(tryUnload(x, y));
+        }
+
+        /**
+         * Unloads container from given position, or returns why it can't be unloaded
+         */
+        ShipResult<Container> tryUnload(X x, Y y) {
+            if (auto error = checkXY(x, y)) {
+                return *error;
+            }
+            int stack = stackIndex(x, y);
+            if (containers.height(stack) == 0) {
+                return ShipError{ShipErrorCode::NoContainerToUnload, x, y};
+            }
+
+            prepareWrite(stack);
+            int height = containers.height(stack) - 1;
+            groupIndex.removeContainerFromAllGroups({X{x}, Y{y}, Height{height}});
+            Container unloaded = containers.pop(stack);
+            stackChanged(stack, -1);
+            return unloaded;
+        }
+
+        /**
+         * Unloads the container with the given id if it's on top of its stack. The container is moved out of the ship
+         */
+        Container unload(ContainerId id) noexcept(false) {
+            return valueOrThrow(tryUnload(id));
+        }
+
+        /**
+         * Unloads the container with the given id, or returns why it can't be unloaded
+         */
+        ShipResult<Container> tryUnload(ContainerId id) {
+            auto location = containers.locate(id);
+            if (!location) {
+                return ShipError{ShipErrorCode::UnknownContainer, -1, -1};
+            }
+            auto[stack, height] = *location;
+            if (height + 1 != containers.height(stack)) {
+                return ShipError{ShipErrorCode::ContainerNotOnTop, stack / shipY(), stack % shipY()};
+            }
+            return tryUnload(X{stack / shipY()}, Y{stack % shipY()});
+        }
+
+        /**
+         * Returns the position of the container with the given id, or nothing if it isn't loaded on the ship
+         */
+        std::optional<Position> locate(ContainerId id) const {
+            auto location = containers.locate(id);
+            if (!location) {
+                return std::nullopt;
+            }
+            auto[stack, height] = *location;
+            return Position{X{stack / shipY()}, Y{stack % shipY()}, Height{height}};
+        }
+
+        /**
+         * Returns the id of the container at the given position, or nothing if there is no container there
+         */
+        std::optional<ContainerId> idAt(X x, Y y, Height height) const {
+            if (checkXY(x, y) || height < 0 || height >= containers.height(stackIndex(x, y))) {
+                return std::nullopt;
+            }
+            return containers.idAt(stackIndex(x, y), height);
+        }
+
+        /**
+         * Moves container from given source position to given target position
+         * If there is container in the source position and space in the target position
+         */
+        void move(X fromX, Y fromY, X toX, Y toY) noexcept(false) {
+            valueOrThrow(tryMove(fromX, fromY, toX, toY));
+        }
+
+        /**
+         * Moves container from given source position to given target position, or returns why it can't be moved
+         */
+        ShipResult<void> tryMove(X fromX, Y fromY, X toX, Y toY) {
+            if (auto error = checkXY(fromX, fromY)) {
+                return *error;
+            }
+            if (auto error = checkXY(toX, toY)) {
+                return *error;
+            }
+
+            // First check if there is container to move
+            if (containers.height(stackIndex(fromX, fromY)) == 0) {
+                return ShipError{ShipErrorCode::NoContainerToMove, fromX, fromY};
+            }
+
+            // If moving from position to the same position, do nothing
+            if (fromX == toX && fromY == toY) {
+                return {};
+            }
+
+            // Check that there is space in the target position
+            if (containers.spacesLeft(stackIndex(toX, toY)) == 0) {
+                return ShipError{ShipErrorCode::NoSpaceToMove, toX, toY};
+            }
+
+            // Finally move the container to the target stack and point its group entries to the new position
+            int fromStack = stackIndex(fromX, fromY), toStack = stackIndex(toX, toY);
+            prepareWrite(fromStack);
+            prepareWrite(toStack);
+            int fromHeight = containers.height(fromStack) - 1, toHeight = containers.height(toStack);
+            auto &moved = containers.transfer(fromStack, toStack);
+            stackChanged(fromStack, -1);
+            stackChanged(toStack, 1);
+            groupIndex.relocateContainerInAllGroups({fromX, fromY, Height{fromHeight}}, {toX, toY, Height{toHeight}}, moved);
+            return {};
+        }
+
+        ShipCargoIterator begin() const {
+            return ShipCargoIterator(containers.handle(), 0);
+        }
+
+        ShipCargoIterator end() const {
+            return ShipCargoIterator(containers.handle(), containers.size());
+        }
+
+        /**
+         * Returns view of containers in the given (x, y) position
+         */
+        PositionView getContainersViewByPosition(X x, Y y) const {
+            if (x < 0 || x >= shipX() || y < 0 || y >= shipY()) // Bad (x, y) given
+                return PositionView();
+
+            int stack = stackIndex(x, y);
+            return PositionView(containers, stack);
+        }
+
+        /**
+         * Returns view of all containers in the ship yielding (position, container), in the order of begin() and end()
+         */
+        auto getContainersViewWithPositions() const {
+            return getCargoView().withPositions();
+        }
+
+        /**
+         * Returns view of all containers in the ship, it can be split into subranges of stacks
+         */
+        CargoRange getCargoView() const {
+            return CargoRange(containers.handle(), 0, containers.size());
+        }
+
+        /**
+         * Returns view of containers in all stacks of the given bay
+         */
+        CargoRange getContainersViewByBay(X x) const {
+            if (x < 0 || x >= shipX()) // Bad x given
+                return CargoRange(containers.handle(), 0, 0);
+
+            return CargoRange(containers.handle(), stackIndex(x, 0), stackIndex(x + 1, 0));
+        }
+
+        /**
+         * Returns view of containers in all stacks of bays x0..x1 and rows y0..y1, bay by bay and bottom up in every stack.
+         * The region is empty if a corner is outside the ship or the corners are out of order
+         */
+        auto getContainersViewByRegion(X x0, Y y0, X x1, Y y1) const {
+            bool bad = checkXY(x0, y0) || checkXY(x1, y1) || x0 > x1 || y0 > y1;
+            int rows = bad ? 0 : y1 - y0 + 1, stacks = bad ? 0 : (x1 - x0 + 1) * rows;
+            int first = bad ? 0 : stackIndex(x0, y0), sizeY = shipY();
+            return std::views::iota(0, stacks) | std::views::transform([first, rows, sizeY](int i) {
+                return first + i / rows * sizeY + i % rows;
+            }) | std::views::transform(StackContainers(containers)) | std::views::join;
+        }
+
+    private:
+        /**
+         * Returns view of the containers of the given layer's stacks at its height as (position, container)
+         */
+        static auto layerView(const typename Layers::Layer &stacks, StackContainers stackContainers, int sizeY, Height height) {
+            return std::views::all(stacks) | std::views::transform([stackContainers, sizeY, height](std::uint32_t stack) -> GroupEntry<Container> {
+                return {Position{X{int(stack) / sizeY}, Y{int(stack) % sizeY}, height}, stackContainers(int(stack))[height]};
+            });
+        }
+
+    public:
+        /**
+         * Returns view of the containers at the given height across the ship as (position, container), in no particular order.
+         * Costs O(containers at that height), bound to the layer so it sees later loads and unloads. Bad height gives an empty view
+         */
+        auto getContainersViewByLayer(Height height) const requires (!Arena::copyOnWrite) {
+            static const typename Layers::Layer noStacks;
+            const auto &stacks = height < 0 || height >= shipHeight() ? noStacks : layers.layer(height);
+            return layerView(stacks, StackContainers(containers), shipY(), height);
+        }
+
+        /**
+         * Returns view of all containers as (position, container), layer by layer from the bottom of the ship up
+         */
+        auto getContainersViewByLayers() const requires (!Arena::copyOnWrite) {
+            return std::views::iota(0, shipHeight()) | std::views::transform(
+                    [allLayers = layers.allLayers(), stackContainers = StackContainers(containers), sizeY = shipY()](int height) {
+                        return layerView(allLayers[height], stackContainers, sizeY, Height{height});
+                    }) | std::views::join;
+        }
+
+        /**
+         * Returns the number of containers in stacks of bays x0..x1 and rows y0..y1 in O(log X * log Y),
+         * in O(stacks of the region) on ships cloned in O(1). 0 for a bad region
+         */
+        int getContainersCountByRegion(X x0, Y y0, X x1, Y y1) const {
+            if (checkXY(x0, y0) || checkXY(x1, y1) || x0 > x1 || y0 > y1) {
+                return 0;
+            }
+            if constexpr (cheapClones) {
+                return sumRegion(x0, y0, x1, y1, [this](int stack) { return containers.height(stack); });
+            } else {
+                return int(regionCounts.count(x0, y0, x1, y1));
+            }
+        }
+
+        /**
+         * Returns the number of free slots in stacks of bays x0..x1 and rows y0..y1 in O(log X * log Y),
+         * in O(stacks of the region) on ships cloned in O(1). 0 for a bad region
+         */
+        int getSpacesLeftByRegion(X x0, Y y0, X x1, Y y1) const {
+            if (checkXY(x0, y0) || checkXY(x1, y1) || x0 > x1 || y0 > y1) {
+                return 0;
+            }
+            if constexpr (cheapClones) {
+                return sumRegion(x0, y0, x1, y1, [this](int stack) { return containers.spacesLeft(stack); });
+            } else {
+                return int(regionCounts.capacity(x0, y0, x1, y1) - regionCounts.count(x0, y0, x1, y1));
+            }
+        }
+
+        /**
+         * Calls fn for every container in the ship. With ExecutionPolicy::Parallel the ship is split into chunks of stacks
+         * scanned on up to hardware_concurrency threads, so fn must be safe to call concurrently.
+         * The ship must not be changed during the call
+         */
+        template<typename Function>
+        void parallelForEach(ExecutionPolicy policy, Function fn) const {
+            if (policy == ExecutionPolicy::Sequenced) {
+                for (const auto &container: *this) {
+                    fn(container);
+                }
+                return;
+            }
+            // A few chunks per thread so a thread that got lightly loaded stacks picks up more
+            std::size_t stacks = containers.size(), threads = std::max(1u, std::thread::hardware_concurrency());
+            std::size_t chunkSize = std::max<std::size_t>(1, stacks / (threads * 8));
+            parallelFor((stacks + chunkSize - 1) / chunkSize, [&](std::size_t chunk) {
+                int from = int(chunk * chunkSize), to = int(std::min(stacks, (chunk + 1) * chunkSize));
+                for (const auto &container: CargoRange(containers.handle(), from, to)) {
+                    fn(container);
+                }
+            });
+        }
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+        /**
+         * Forward iterator over all containers in the ship, stack by stack and bottom up in every stack.
+         * Bound to the arena storage, so it goes over the ship the cargo was moved to
+         */
+        class ShipCargoIterator {
+            typename Arena::Handle arena;
+            int stack = 0;  // Index of the current stack in the arena
+            int height = 0; // Height of the current container in the current stack
+
+            void setIteratorToNonEmptyPosition() {
+                // Check if we have more containers in the current stack, if yes return
+                if (++height < arena.height(stack)) {
+                    return;
+                }
+
+                // Jump to the next not empty stack using the arena occupancy bitmap
+                height = 0;
+                stack = arena.nextOccupied(stack + 1);
+            }
+
+        public:
+            using value_type = Container;
+            using difference_type = std::ptrdiff_t;
+            using iterator_concept = std::forward_iterator_tag;
+            using iterator_category = std::forward_iterator_tag;
+
+            ShipCargoIterator(typename Arena::Handle arena, int stack)
+                    : arena(arena), stack(arena.nextOccupied(stack)), height(0) {}
+
+            ShipCargoIterator() = default;
+
+            ShipCargoIterator &operator++() {
+                setIteratorToNonEmptyPosition();
+                return *this;
+            }
+
+            ShipCargoIterator operator++(int) {
+                auto copy = *this;
+                setIteratorToNonEmptyPosition();
+                return copy;
+            }
+
+            const Container &operator*() const {
+                return arena.at(stack, height);
+            }
+
+            /**
+             * Returns the position of the current container, computed from the iterator state without a lookup
+             */
+            Position position() const {
+                return Position{X{stack / arena.sizeY()}, Y{stack % arena.sizeY()}, Height{height}};
+            }
+
+            bool operator==(const ShipCargoIterator &other) const {
+                return stack == other.stack && height == other.height;
+            }
+        };
+
+        /**
+         * Forward iterator over all containers in the ship yielding (position, container) like group views do
+         */
+        class PositionedCargoIterator {
+            ShipCargoIterator itr;
+
+        public:
+            using value_type = GroupEntry<Container>;
+            using difference_type = std::ptrdiff_t;
+            using iterator_concept = std::forward_iterator_tag;
+
+            explicit PositionedCargoIterator(ShipCargoIterator itr) : itr(itr) {}
+
+            PositionedCargoIterator() = default;
+
+            PositionedCargoIterator &operator++() {
+                ++itr;
+                return *this;
+            }
+
+            PositionedCargoIterator operator++(int) {
+                auto copy = *this;
+                ++itr;
+                return copy;
+            }
+
+            GroupEntry<Container> operator*() const {
+                return {itr.position(), *itr};
+            }
+
+            bool operator==(const PositionedCargoIterator &other) const = default;
+        };
+
+        using PositionedCargoView = std::ranges::subrange<PositionedCargoIterator>;
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+        /**
+         * View of the containers in a contiguous interval of stacks [fromStack, toStack), bay by bay.
+         * split() halves it so the parts can be scanned by different threads.
+         * Bound to the arena storage like the position and group views, so it shows the ship the cargo was moved to
+         */
+        class CargoRange : public std::ranges::view_interface<CargoRange> {
+            typename Arena::Handle arena;
+            int fromStack = 0;
+            int toStack = 0;
+
+        public:
+            CargoRange(typename Arena::Handle arena, int fromStack, int toStack) : arena(arena), fromStack(fromStack), toStack(toStack) {}
+
+            CargoRange() = default;
+
+            ShipCargoIterator begin() const {
+                return ShipCargoIterator(arena, fromStack);
+            }
+
+            // Both ends skip forward to the same next occupied stack, so iteration stops at toStack
+            ShipCargoIterator end() const {
+                return ShipCargoIterator(arena, toStack);
+            }
+
+            /**
+             * Returns the same containers yielding (position, container)
+             */
+            PositionedCargoView withPositions() const {
+                return {PositionedCargoIterator(begin()), PositionedCargoIterator(end())};
+            }
+
+            int stackCount() const {
+                return toStack - fromStack;
+            }
+
+            bool isDivisible() const {
+                return stackCount() > 1;
+            }
+
+            std::pair<CargoRange, CargoRange> split() const {
+                int middle = fromStack + stackCount() / 2;
+                return {CargoRange(arena, fromStack, middle), CargoRange(arena, middle, toStack)};
+            }
+        };
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+        /**
+         * Gives the containers of a stack bottom up, for views built lazily over stack indexes.
+         * Bound to the arena storage, so it keeps working after the ship is moved
+         */
+        class StackContainers {
+            typename Arena::Handle arena;
+
+        public:
+            explicit StackContainers(const Arena &arena) : arena(arena.handle()) {}
+
+            std::span<const Container> operator()(int stack) const {
+                return {arena.stackBase(stack), std::size_t(arena.height(stack))};
+            }
+        };
+
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+        /**
+         * View of the containers matched by a group query, in slot order, yielding (position, container).
+         * Holds the slots matched when the query ran and skips those emptied since, a slot loaded again shows its new container.
+         * Bound to the arena storage, so it shows the ship the cargo was moved to
+         */
+        class QueryView : public std::ranges::view_interface<QueryView> {
+            typename Arena::Handle arena;
+            std::shared_ptr<const std::vector<std::uint64_t>> bits;
+
+        public:
+            class Iterator {
+                typename Arena::Handle arena;
+                const std::vector<std::uint64_t> *words = nullptr;
+                std::size_t word = 0;
+                std::uint64_t remaining = 0; // Bits of the current word not visited yet
+
+                std::size_t slot() const {
+                    return word * 64 + std::countr_zero(remaining);
+                }
+
+                /**
+                 * Moves to the next matched slot that still holds a container, starting with the current one
+                 */
+                void skipEmptySlots() {
+                    while (true) {
+                        while (remaining == 0 && ++word < words->size()) {
+                            remaining = (*words)[word];
+                        }
+                        if (remaining == 0 || int(slot() % arena.sizeHeight()) < arena.height(int(slot() / arena.sizeHeight()))) {
+                            return;
+                        }
+                        remaining &= remaining - 1;
+                    }
+                }
+
+            public:
+                using value_type = GroupEntry<Container>;
+                using difference_type = std::ptrdiff_t;
+                using iterator_concept = std::forward_iterator_tag;
+
+                Iterator(typename Arena::Handle arena, const std::vector<std::uint64_t> &words, std::size_t word)
+                        : arena(arena), words(&words), word(word), remaining(word < words.size() ? words[word] : 0) {
+                    if (word < words.size()) {
+                        skipEmptySlots();
+                    }
+                }
+
+                Iterator() = default;
+
+                Iterator &operator++() {
+                    remaining &= remaining - 1;
+                    skipEmptySlots();
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    auto copy = *this;
+                    ++*this;
+                    return copy;
+                }
+
+                GroupEntry<Container> operator*() const {
+                    int stack = int(slot() / arena.sizeHeight()), height = int(slot() % arena.sizeHeight());
+                    return {Position{X{stack / arena.sizeY()}, Y{stack % arena.sizeY()}, Height{height}}, arena.at(stack, height)};
+                }
+
+                bool operator==(const Iterator &other) const {
+                    return word == other.word && remaining == other.remaining;
+                }
+            };
 
-    public:
-        explicit BadShipOperationException(std::string msg) : message(std::move(msg)) {}
-    };
+            QueryView(typename Arena::Handle arena, std::shared_ptr<const std::vector<std::uint64_t>> bits) : arena(arena), bits(std::move(bits)) {}
 
+            QueryView() = default;
 
-    template<typename Container>
-    using Grouping = std::unordered_map<std::string, std::function<std::string(const Container &)>>;
+            Iterator begin() const {
+                return bits ? Iterator(arena, *bits, 0) : Iterator();
+            }
 
-    template<typename Container>
-    class Ship {
-    public: // Forward Decelerations
+            Iterator end() const {
+                return bits ? Iterator(arena, *bits, bits->size()) : Iterator();
+            }
 
-        class ShipCargoIterator;
+            /**
+             * Returns the number of matches when the query ran, counted a word at a time
+             */
+            std::size_t count() const {
+                std::size_t matches = 0;
+                if (bits) {
+                    for (std::uint64_t word: *bits) {
+                        matches += std::popcount(word);
+                    }
+                }
+                return matches;
+            }
+        };
 
-        class GroupView;
+        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        class PositionView;
+        /**
+         * View for a specific position containers
+         */
+        class PositionView : public std::ranges::view_interface<PositionView> {
+            // The stack is looked up through the arena storage when iterating, copy-on-write arenas replace a stack when they detach it.
+            // The handle follows the cargo when the ship is moved
+            typename Arena::Handle arena;
+            int stack = 0;
+            using iterType = std::reverse_iterator<const Container *>;
 
-    private:
-        X shipX;
-        Y shipY;
-        Height shipHeight;
-        std::vector<std::vector<int>> spacesLeftAtPosition;
-        std::vector<std::vector<Container>> containers;
+        public:
 
-        Grouping<Container> groupingFunctions;
-        using PositionToContainer = std::map<Position, const Container &>;
-        using Group = std::unordered_map<std::string, PositionToContainer>;
-        mutable std::unordered_map<std::string, Group> groups;
+            PositionView(const Arena &arena, int stack) : arena(arena.handle()), stack(stack) {}
 
-    public:
-        Ship(X x, Y y, Height height) noexcept
-                : shipX(x), shipY(y), shipHeight(height) {
-            spacesLeftAtPosition = std::vector<std::vector<int>>(x, std::vector<int>(y, height));
-            containers.resize(x * y);
+            PositionView() = default;
 
-            // Reserve enough space for each position, otherwise the vector gets reallocated and the Views don't work well
-            for (std::vector<Container> &vec: containers) {
-                vec.reserve(height + 1);
+            auto begin() const {
+                if (stack >= arena.size())
+                    return iterType();
+                return iterType(arena.stackBase(stack) + arena.height(stack));
             }
-        }
 
-        Ship(X x, Y y, Height max_height, const std::vector<Position> &restrictions) noexcept(false)
-                : Ship(x, y, max_height) {
-            validateRestrictions(restrictions);
-            for (Position res : restrictions) {
-                int resX = std::get<0>(res), resY = std::get<1>(res), resHeight = std::get<2>(res);
-                spacesLeftAtPosition[resX][resY] = resHeight;
+            auto end() const {
+                if (stack >= arena.size())
+                    return iterType();
+                return iterType(arena.stackBase(stack));
             }
-        }
+        };
+    };
 
-        Ship(X x, Y y, Height max_height, const std::vector<Position> &restrictions, Grouping<Container> groupingFunctions) noexcept(false)
-                : Ship(x, y, max_height, restrictions) {
-            this->groupingFunctions = groupingFunctions;
-        }
+    /**
+     * Ship with grouping functions registered at runtime by name
+     */
+    template<typename Container, GroupKeyType GroupKey = std::string>
+    class Ship : public BasicShip<Container, DynamicGroupIndex<Container, GroupKey>> {
+        using Base = BasicShip<Container, DynamicGroupIndex<Container, GroupKey>>;
 
-        Ship(const Ship &) = delete;
+    public:
+        using GroupView = typename GroupTable<Container, GroupKey>::GroupView;
 
-        Ship &operator=(const Ship &) = delete;
+        using Query = GroupQuery<GroupKey>;
 
-        Ship(Ship &&) = delete;
+        using Base::Base;
 
-        Ship &operator=(Ship &&) = delete;
+        Ship(X x, Y y, Height max_height, const std::vector<Position> &restrictions, Grouping<Container, GroupKey> groupingFunctions) noexcept(false)
+                : Base(x, y, max_height, restrictions) {
+            this->groupIndex.registerGroupings(std::move(groupingFunctions));
+        }
 
-    private:
         /**
-         * Validates the given restrictions
+         * Returns view of containers of the given group
          */
-        void validateRestrictions(const std::vector<Position> &restrictions) noexcept(false) {
-            std::set<std::tuple<int, int>> xyHistory;
+        GroupView getContainersViewByGroup(std::string_view groupingName, GroupKeyLookup<GroupKey> groupName) const {
+            auto grouping = this->groupIndex.find(groupingName);
+            return grouping ? GroupView(*grouping, groupName) : GroupView{};
+        }
 
-            for (Position res : restrictions) {
-                int x = std::get<0>(res), y = std::get<1>(res), height = std::get<2>(res);
-                validateXY(x, y);
-                if (height < 0 || height >= shipHeight) {
-                    throw BadShipOperationException(
-                            "received position with bad height value. Height value is" + std::to_string(height) + ", ship X is " + std::to_string(shipHeight));
-                }
-                if (xyHistory.find({x, y}) != xyHistory.end()) {
-                    std::string msg = "received duplicate restriction for X,Y : (" + std::to_string(x) + ", " +
-                                      std::to_string(y) + ")";
-                    throw BadShipOperationException(msg);
-                }
+        /**
+         * Keeps sum, min and max of projection(container) in every group, see groupStats
+         */
+        void registerAggregate(std::string name, std::function<double(const Container &)> projection) {
+            this->groupIndex.registerAggregate(std::move(name), std::move(projection));
+        }
 
-                xyHistory.insert({x, y});
-            }
+        /**
+         * Returns the number of containers in the given group and its aggregates, without iterating the group
+         */
+        GroupStats<Container> groupStats(std::string_view groupingName, GroupKeyLookup<GroupKey> groupName) const {
+            auto grouping = this->groupIndex.find(groupingName);
+            return grouping ? grouping->stats(groupName) : GroupStats<Container>{};
         }
 
         /**
-         * Validates (x, y) are legal
+         * Returns view of the containers matching a combination of groups, e.g.
+         * query(Query::group("port", "Haifa") & Query::group("type", "reefer")). Groups of unknown groupings are empty
          */
-        void validateXY(int x, int y) const noexcept(false) {
-            if (x < 0 || x >= shipX)
-                throw BadShipOperationException(
-                        "received position with bad X value. X value is" + std::to_string(x) + ", ship X is " + std::to_string(shipX));
+        typename Base::QueryView query(const Query &q) const {
+            return this->runQuery(q, [this](std::string_view groupingName) { return this->groupIndex.find(groupingName); });
+        }
+    };
+
+    /**
+     * Ship that can be cloned in O(1), a clone shares the stacks and groups of its origin until either of them changes them.
+     * A change copies only the changed stacks, their bays, and the group tables of those bays if they're still shared.
+     * References taken from a ship are invalidated when a change copies the stack they refer to
+     */
+    template<typename Container, GroupKeyType GroupKey = std::string>
+    class CopyOnWriteShip : public BasicShip<Container, SharedGroupIndex<Container, GroupKey>, SharedCargoArena<Container>> {
+        using Index = SharedGroupIndex<Container, GroupKey>;
+        using Base = BasicShip<Container, Index, SharedCargoArena<Container>>;
+
+    public:
+        using GroupView = typename Index::GroupView;
+
+        using Query = GroupQuery<GroupKey>;
 
-            if (y < 0 || y >= shipY)
-                throw BadShipOperationException(
-                        "received position with bad Y value. Y value is" + std::to_string(y) + ", ship Y is " + std::to_string(shipY));
+        CopyOnWriteShip(X x, Y y, Height max_height) noexcept: Base(x, y, max_height) {}
+
+        CopyOnWriteShip(X x, Y y, Height max_height, const std::vector<Position> &restrictions) noexcept(false)
+                : Base(x, y, max_height, restrictions) {}
+
+        CopyOnWriteShip(X x, Y y, Height max_height, const std::vector<Position> &restrictions, Grouping<Container, GroupKey> groupingFunctions) noexcept(false)
+                : Base(x, y, max_height, restrictions) {
+            this->groupIndex.registerGroupings(std::move(groupingFunctions));
         }
 
         /**
-         * Returns the containers from the given (x, y) position - const version
+         * Returns a ship with the same cargo and groups, sharing them with this ship. Same as copying the ship
          */
-        const std::vector<Container> &getContainers(int x, int y) const {
-            return containers[x * shipY + y];
+        CopyOnWriteShip clone() const {
+            return *this;
         }
 
         /**
-         * Returns the containers from the given (x, y) position
+         * Returns view of containers of the given group
          */
-        std::vector<Container> &getContainers(int x, int y) {
-            return containers[x * shipY + y];
+        GroupView getContainersViewByGroup(std::string_view groupingName, GroupKeyLookup<GroupKey> groupName) const {
+            auto grouping = this->groupIndex.find(groupingName);
+            return grouping ? grouping->view(groupName) : GroupView{};
         }
 
         /**
-         * Adds container to all relevant groups by it's position
+         * Keeps sum, min and max of projection(container) in every group, see groupStats
          */
-        void addContainerToAllGroups(Container &container, Position pos) {
-            for (auto &groupNameAndFunction: groupingFunctions) {
-                groups[groupNameAndFunction.first][groupNameAndFunction.second(container)].insert({pos, container});
-            }
+        void registerAggregate(std::string name, std::function<double(const Container &)> projection) {
+            this->groupIndex.registerAggregate(std::move(name), std::move(projection));
         }
 
         /**
-         * Removes container from all groups by it's position
+         * Returns the number of containers in the given group and its aggregates, without iterating the group
          */
-        void removeContainerFromAllGroups(Container &container, Position pos) {
-            for (auto &groupNameAndFunction: groupingFunctions) {
-                groups[groupNameAndFunction.first][groupNameAndFunction.second(container)].erase(pos);
-            }
+        GroupStats<Container> groupStats(std::string_view groupingName, GroupKeyLookup<GroupKey> groupName) const {
+            auto grouping = this->groupIndex.find(groupingName);
+            return grouping ? grouping->stats(groupName) : GroupStats<Container>{};
         }
 
+        /**
+         * Returns view of the containers matching a combination of groups, e.g.
+         * query(Query::group("port", "Haifa") & Query::group("type", "reefer")). Groups of unknown groupings are empty
+         */
+        typename Base::QueryView query(const Query &q) const {
+            return this->runQuery(q, [this](std::string_view groupingName) { return this->groupIndex.find(groupingName); });
+        }
+    };
+
+    /**
+     * Consistent read-only copy of the cargo of a ship at one instant, it shares the stacks with the ship until the ship changes them.
+     * A stack version is reclaimed once the ship and every snapshot holding it let go of it
+     */
+    template<typename Container, typename Key>
+    class ShipSnapshot {
+        int shipY;
+        std::vector<std::shared_ptr<const StackVersion<Container>>> stacks;
+        std::shared_ptr<const GroupingLookup<Container, Key>> groupingFunctions;
+
     public:
+        ShipSnapshot(int shipY, std::vector<std::shared_ptr<const StackVersion<Container>>> stacks,
+                     std::shared_ptr<const GroupingLookup<Container, Key>> groupingFunctions)
+                : shipY(shipY), stacks(std::move(stacks)), groupingFunctions(std::move(groupingFunctions)) {}
 
         /**
-         * Loads container to the given position if the position is legal and there is free space in it
+         * Iterator over all containers of the snapshot, stack by stack from the bottom up
          */
-        void load(X x, Y y, Container c) noexcept(false) {
-            validateXY(x, y);
-            if (spacesLeftAtPosition[x][y] == 0) {
-                throw BadShipOperationException("Can't load container, no space left in position : (" + std::to_string(x) + ", " + std::to_string(y) + ")");
+        class Iterator {
+            const ShipSnapshot *snapshot = nullptr;
+            int stack = 0;
+            int height = 0;
+
+            void skipEmptyStacks() {
+                while (stack < int(snapshot->stacks.size()) && snapshot->stacks[stack]->height == 0) {
+                    ++stack;
+                }
             }
 
-            getContainers(x, y).push_back(c);
-            --spacesLeftAtPosition[x][y];
-            int height = getContainers(x, y).size() - 1;
-            auto &topContainer = getContainers(x, y).back();
-            addContainerToAllGroups(topContainer, {X{x}, Y{y}, Height{height}});
-        }
+            void next() {
+                if (++height == snapshot->stacks[stack]->height) {
+                    height = 0;
+                    ++stack;
+                    skipEmptyStacks();
+                }
+            }
 
-        /**
-         * Unloads container from given position if the position is legal and there is at least one container there
-         */
-        Container unload(X x, Y y) noexcept(false) {
-            validateXY(x, y);
-            if (getContainers(x, y).empty()) {
-                throw BadShipOperationException(
-                        "Can't unload container, no container found in position : (" + std::to_string(x) + ", " + std::to_string(y) + ")");
+        public:
+            using value_type = Container;
+            using difference_type = std::ptrdiff_t;
+            using iterator_concept = std::forward_iterator_tag;
+            using iterator_category = std::forward_iterator_tag;
+
+            Iterator(const ShipSnapshot &snapshot, int stack) : snapshot(&snapshot), stack(stack) {
+                skipEmptyStacks();
             }
 
-            int height = getContainers(x, y).size() - 1;
-            auto &container = getContainers(x, y).back();
-            removeContainerFromAllGroups(container, {X{x}, Y{y}, Height{height}});
+            Iterator() = default;
+
+            Iterator &operator++() {
+                next();
+                return *this;
+            }
 
-            getContainers(x, y).pop_back();
-            ++spacesLeftAtPosition[x][y];
+            Iterator operator++(int) {
+                auto copy = *this;
+                next();
+                return copy;
+            }
 
-            return container;
-        }
+            const Container &operator*() const {
+                return snapshot->stacks[stack]->containers[height];
+            }
+
+            /**
+             * Returns the position of the current container in the snapshot
+             */
+            Position position() const {
+                return Position{X{stack / snapshot->shipY}, Y{stack % snapshot->shipY}, Height{height}};
+            }
+
+            bool operator==(const Iterator &other) const {
+                return stack == other.stack && height == other.height;
+            }
+        };
 
         /**
-         * Moves container from given source position to given target position
-         * If there is container in the source position and space in the target position
+         * View of the containers of one stack in the snapshot, top to bottom
          */
-        void move(X fromX, Y fromY, X toX, Y toY) noexcept(false) {
+        class PositionView {
+            const StackVersion<Container> *stack = nullptr;
+            using iterType = std::reverse_iterator<const Container *>;
 
-            validateXY(fromX, fromY);
-            validateXY(toX, toY);
+        public:
+            explicit PositionView(const StackVersion<Container> *stack) : stack(stack) {}
 
-            // First check if there is container to move
-            if (getContainers(fromX, fromY).empty()) {
-                throw BadShipOperationException(
-                        "Can't move container, no container found in source position : (" + std::to_string(fromX) + ", " + std::to_string(fromY) + ")");
-            }
+            PositionView() = default;
 
-            // If moving from position to the same position, do nothing
-            if (fromX == toX && fromY == toY) {
-                return;
+            auto begin() const {
+                return stack ? iterType(stack->containers.data() + stack->height) : iterType();
             }
 
-            // Check that there is space in the target position
-            if (spacesLeftAtPosition[toX][toY] == 0) {
-                throw BadShipOperationException(
-                        "Can't move container, no space left in target position : (" + std::to_string(toX) + ", " + std::to_string(toY) + ")");
+            auto end() const {
+                return stack ? iterType(stack->containers.data()) : iterType();
             }
+        };
 
-            // Finally unload and then load
-            auto container = unload(fromX, fromY);
-            load(toX, toY, container);
-        }
-
-        ShipCargoIterator begin() const {
-            return ShipCargoIterator(containers.begin(), containers.end());
+        Iterator begin() const {
+            return Iterator(*this, 0);
         }
 
-        ShipCargoIterator end() const {
-            return ShipCargoIterator(containers.end(), containers.end());
+        Iterator end() const {
+            return Iterator(*this, int(stacks.size()));
         }
 
-        /**
-         * Returns view of containers in the given (x, y) position
-         */
         PositionView getContainersViewByPosition(X x, Y y) const {
-            if (x < 0 || x >= shipX || y < 0 || y >= shipY) // Bad (x, y) given
+            if (x < 0 || y < 0 || y >= shipY || x * shipY + y >= int(stacks.size())) {
                 return PositionView();
-
-            auto &xyContainers = getContainers(x, y);
-            return PositionView(xyContainers);
+            }
+            return PositionView(stacks[x * shipY + y].get());
         }
 
         /**
-         * Returns view of containers of the given group
+         * Returns the containers of the given group in the snapshot, found by calling the grouping function on every container
          */
-        GroupView getContainersViewByGroup(const std::string &groupingName, const std::string &groupName) const {
-            auto itr = groups.find(groupingName);
-            if (itr == groups.end() && groupingFunctions.find(groupingName) != groupingFunctions.end()) {
-                auto[insert_itr, _] = groups.insert({groupingName, Group{}});
-                itr = insert_itr;
+        GroupEntries<Container> getContainersViewByGroup(std::string_view groupingName, GroupKeyLookup<Key> groupName) const {
+            GroupEntries<Container> entries;
+            auto grouping = groupingFunctions->find(groupingName);
+            if (grouping == groupingFunctions->end()) {
+                return entries;
             }
-            if (itr != groups.end()) {
-                const auto &grouping = itr->second;
-                auto itr2 = grouping.find(groupName);
-                if (itr2 == grouping.end()) {
-                    auto[insert_itr, _] = itr->second.insert({groupName, PositionToContainer{}});
-                    itr2 = insert_itr;
+            for (int stack = 0; stack < int(stacks.size()); ++stack) {
+                for (int height = 0; height < stacks[stack]->height; ++height) {
+                    const Container &container = stacks[stack]->containers[height];
+                    if (GroupKeyEqual<Key>{}(grouping->second(container), groupName)) {
+                        entries.emplace_back(Position{X{stack / shipY}, Y{stack % shipY}, Height{height}}, container);
+                    }
                 }
-                return GroupView(itr2->second);
             }
-            return GroupView{};
+            return entries;
         }
+    };
 
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /**
+     * Ship that may be loaded, unloaded and moved from several threads at once.
+     * Stacks are split into stripes of consecutive (x, y) positions, an operation holds the locks of the stripes it changes,
+     * and groups are split into separately locked shards. Views, iteration and returned references aren't synchronized,
+     * they are meant to be used while no other thread changes the ship. Threads reading while others write use snapshot()
+     */
+    template<typename Container, GroupKeyType GroupKey = std::string>
+    class ConcurrentShip : public BasicShip<Container, ShardedGroupIndex<Container, GroupKey>, VersionedCargoArena<Container>> {
+        using Base = BasicShip<Container, ShardedGroupIndex<Container, GroupKey>, VersionedCargoArena<Container>>;
+
+        static constexpr int maxStripes = 64;
 
         /**
-         * Iterator that iterates over all containers in the ship
+         * Stacks of a snapshot being taken. Every stripe is shared into it under the stripe lock,
+         * by the snapshot or by the first writer that locks the stripe after the snapshot started
          */
-        class ShipCargoIterator {
-            using CargoIterator = typename std::vector<std::vector<Container>>::const_iterator;
-            using PositionIterator = typename std::vector<Container>::const_iterator;
-
-            CargoIterator positionsIterator;  // Iterates over non-empty positions in the ship
-            CargoIterator positionsIteratorEnd; // End of this iterator
-            PositionIterator currentPositionIterator;  // Iterates over containers in the current position
+        struct PendingSnapshot {
+            std::vector<std::shared_ptr<const StackVersion<Container>>> stacks;
+            std::vector<char> shared; // Whether each stripe was shared, guarded by the stripe lock
+        };
 
-            void setIteratorToNonEmptyPosition() {
-                //progress current position iterator
-                ++currentPositionIterator;
-                // Check if we have more containers in the current position, if yes return
-                if (currentPositionIterator != (*positionsIterator).end()) {
-                    return;
-                }
+        int stacksPerStripe;
+        mutable std::vector<std::mutex> stripes;
+        mutable std::mutex snapshotLock; // Lets one snapshot be taken at a time
+        mutable std::shared_ptr<PendingSnapshot> pending; // Replaced under all stripe locks
 
-                // Find next not empty position
-                ++positionsIterator;
-                while (positionsIterator != positionsIteratorEnd && (*positionsIterator).empty()) {
-                    ++positionsIterator;
-                }
+        int stripeOf(int x, int y) const {
+            return this->stackIndex(x, y) / stacksPerStripe;
+        }
 
-                // If we found not empty position set currentPositionIterator
-                if (positionsIterator != positionsIteratorEnd) {
-                    currentPositionIterator = (*positionsIterator).begin();
-                }
+        /**
+         * Locks the given stripe, sharing its stacks first with a snapshot that started before
+         */
+        std::unique_lock<std::mutex> lockStripe(int stripe) const {
+            std::unique_lock guard(stripes[stripe]);
+            if (pending && !pending->shared[stripe]) {
+                int from = stripe * stacksPerStripe;
+                this->containers.share(from, std::min(from + stacksPerStripe, this->containers.size()), pending->stacks);
+                pending->shared[stripe] = true;
             }
+            return guard;
+        }
 
-        public:
-            ShipCargoIterator(CargoIterator itr_start, CargoIterator itr_end)
-                    : positionsIterator(itr_start), positionsIteratorEnd(itr_end) {
-                if (itr_start != itr_end) {
-                    currentPositionIterator = (*itr_start).begin() - 1;
-                    setIteratorToNonEmptyPosition();
-                }
+        /**
+         * Locks the stripe of the given position, illegal positions change nothing so they aren't locked
+         */
+        std::unique_lock<std::mutex> lockStack(int x, int y) const {
+            if (this->checkXY(x, y)) {
+                return {};
             }
+            return lockStripe(stripeOf(x, y));
+        }
 
-            ShipCargoIterator operator++() {
-                setIteratorToNonEmptyPosition();
-                return *this;
+        /**
+         * Locks the stripes of both positions, lower stripe first so crossing moves can't deadlock
+         */
+        std::pair<std::unique_lock<std::mutex>, std::unique_lock<std::mutex>> lockStacks(int fromX, int fromY, int toX, int toY) const {
+            if (this->checkXY(fromX, fromY) || this->checkXY(toX, toY)) {
+                return {};
             }
-
-            const Container &operator*() const {
-                return *currentPositionIterator;
+            int first = stripeOf(fromX, fromY), second = stripeOf(toX, toY);
+            if (first == second) {
+                return {lockStripe(first), std::unique_lock<std::mutex>()};
             }
+            auto lower = lockStripe(std::min(first, second));
+            auto upper = lockStripe(std::max(first, second));
+            return {std::move(lower), std::move(upper)};
+        }
 
-            bool operator!=(ShipCargoIterator other) {
-                return positionsIterator != other.positionsIterator;
-            }
-        };
+    public:
+        using GroupView = typename GroupTable<Container, GroupKey>::GroupView;
 
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+        ConcurrentShip(X x, Y y, Height max_height, const std::vector<Position> &restrictions, Grouping<Container, GroupKey> groupingFunctions) noexcept(false)
+                : Base(x, y, max_height, restrictions), stacksPerStripe(std::max(1, (x * y + maxStripes - 1) / maxStripes)),
+                  stripes((x * y + stacksPerStripe - 1) / stacksPerStripe) {
+            this->groupIndex.registerGroupings(std::move(groupingFunctions));
+        }
+
+        ConcurrentShip(X x, Y y, Height max_height, const std::vector<Position> &restrictions) noexcept(false)
+                : ConcurrentShip(x, y, max_height, restrictions, {}) {}
+
+        ConcurrentShip(X x, Y y, Height max_height) : ConcurrentShip(x, y, max_height, {}) {}
+
+        ContainerId load(X x, Y y, const Container &c) noexcept(false) {
+            auto guard = lockStack(x, y);
+            return Base::load(x, y, c);
+        }
+
+        ContainerId load(X x, Y y, Container &&c) noexcept(false) {
+            auto guard = lockStack(x, y);
+            return Base::load(x, y, std::move(c));
+        }
+
+        template<typename... Args>
+        const Container &emplace(X x, Y y, Args &&... args) noexcept(false) {
+            auto guard = lockStack(x, y);
+            return Base::emplace(x, y, std::forward<Args>(args)...);
+        }
+
+        ShipResult<ContainerId> tryLoad(X x, Y y, const Container &c) {
+            auto guard = lockStack(x, y);
+            return Base::tryLoad(x, y, c);
+        }
+
+        ShipResult<ContainerId> tryLoad(X x, Y y, Container &&c) {
+            auto guard = lockStack(x, y);
+            return Base::tryLoad(x, y, std::move(c));
+        }
+
+        template<typename... Args>
+        ShipResult<const Container *> tryEmplace(X x, Y y, Args &&... args) {
+            auto guard = lockStack(x, y);
+            return Base::tryEmplace(x, y, std::forward<Args>(args)...);
+        }
 
         /**
-         * View for a specific position containers
+         * Loads all the given containers or none of them, holding the stripes of all their positions in stripe order
          */
-        class PositionView {
-            const std::vector<Container> *containers = nullptr;
-            using iterType = typename std::vector<Container>::const_reverse_iterator;
+        void loadBatch(std::span<std::tuple<X, Y, Container>> batch) noexcept(false) {
+            std::vector<int> batchStripes;
+            for (auto &[x, y, _]: batch) {
+                if (!this->checkXY(x, y)) {
+                    batchStripes.push_back(stripeOf(x, y));
+                }
+            }
+            std::sort(batchStripes.begin(), batchStripes.end());
+            batchStripes.erase(std::unique(batchStripes.begin(), batchStripes.end()), batchStripes.end());
+            std::vector<std::unique_lock<std::mutex>> guards;
+            for (int stripe: batchStripes) {
+                guards.push_back(lockStripe(stripe));
+            }
+            Base::loadBatch(batch);
+        }
 
-        public:
+        Container unload(X x, Y y) noexcept(false) {
+            auto guard = lockStack(x, y);
+            return Base::unload(x, y);
+        }
 
-            explicit PositionView(const std::vector<Container> &containers) : containers(&containers) {}
+        ShipResult<Container> tryUnload(X x, Y y) {
+            auto guard = lockStack(x, y);
+            return Base::tryUnload(x, y);
+        }
 
-            PositionView() = default;
+        Container unload(ContainerId id) noexcept(false) {
+            return this->valueOrThrow(tryUnload(id));
+        }
 
-            auto begin() const {
-                return containers ? containers->rbegin() : iterType();
+        /**
+         * Unloads the container with the given id, or returns why it can't be unloaded.
+         * The container may be moved by another thread until its stripe is locked, so it's located again under the lock
+         */
+        ShipResult<Container> tryUnload(ContainerId id) {
+            while (true) {
+                auto position = this->locate(id);
+                if (!position) {
+                    return Base::tryUnload(id);
+                }
+                auto guard = lockStack(std::get<0>(*position), std::get<1>(*position));
+                auto lockedPosition = this->locate(id);
+                if (lockedPosition && std::get<0>(*lockedPosition) == std::get<0>(*position) &&
+                    std::get<1>(*lockedPosition) == std::get<1>(*position)) {
+                    return Base::tryUnload(id);
+                }
             }
+        }
 
-            auto end() const {
-                return containers ? containers->rend() : iterType();
+        void move(X fromX, Y fromY, X toX, Y toY) noexcept(false) {
+            auto guards = lockStacks(fromX, fromY, toX, toY);
+            Base::move(fromX, fromY, toX, toY);
+        }
+
+        ShipResult<void> tryMove(X fromX, Y fromY, X toX, Y toY) {
+            auto guards = lockStacks(fromX, fromY, toX, toY);
+            return Base::tryMove(fromX, fromY, toX, toY);
+        }
+
+        std::optional<ContainerId> idAt(X x, Y y, Height height) const {
+            auto guard = lockStack(x, y);
+            return Base::idAt(x, y, height);
+        }
+
+        /**
+         * Returns a consistent snapshot of the cargo as it was when all stripes were locked to start it.
+         * Stripes are then shared with the snapshot one at a time, a writer first shares the stripes it locks if the snapshot didn't yet.
+         * Later writes copy a stack the first time they change it while the snapshot still holds it
+         */
+        ShipSnapshot<Container, GroupKey> snapshot() const {
+            std::lock_guard serial(snapshotLock);
+            auto next = std::make_shared<PendingSnapshot>();
+            next->stacks.resize(this->containers.size());
+            next->shared.resize(stripes.size());
+            {
+                std::vector<std::unique_lock<std::mutex>> guards;
+                guards.reserve(stripes.size());
+                for (auto &stripe: stripes) {
+                    guards.emplace_back(stripe);
+                }
+                pending = next;
             }
-        };
+            for (int stripe = 0; stripe < int(stripes.size()); ++stripe) {
+                lockStripe(stripe);
+            }
+            return ShipSnapshot<Container, GroupKey>(this->shipY(), std::move(next->stacks), this->groupIndex.groupingFunctions());
+        }
 
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+        /**
+         * Returns view of containers of the given group
+         */
+        GroupView getContainersViewByGroup(std::string_view groupingName, GroupKeyLookup<GroupKey> groupName) const {
+            auto table = this->groupIndex.find(groupingName, groupName);
+            return table ? GroupView(*table, groupName) : GroupView{};
+        }
+    };
+
+    /**
+     * Ship with grouping functions given at compile time, e.g.
+     * GroupedShip<std::string, NamedGrouping<"first_letter", FirstLetter>> and then getContainersViewByGroup<"first_letter">('h')
+     */
+    template<typename Container, typename... Groupings>
+    class GroupedShip : public BasicShip<Container, StaticGroupIndex<Container, Groupings...>> {
+        using Base = BasicShip<Container, StaticGroupIndex<Container, Groupings...>>;
+        using Index = StaticGroupIndex<Container, Groupings...>;
+
+        template<FixedString Name>
+        using KeyOfName = typename Index::template KeyOfName<Name>;
+
+    public:
+        using Base::Base;
 
         /**
-         * View for a specific group containers
+         * Returns view of containers of the given group of the grouping named Name
          */
-        class GroupView {
-            const std::map<Position, const Container &> *pGroup = nullptr;
-            using iterType = typename std::map<Position, const Container &>::const_iterator;
-        public:
-            explicit GroupView(const std::map<Position, const Container &> &group) : pGroup(&group) {}
+        template<FixedString Name>
+        auto getContainersViewByGroup(GroupKeyLookup<KeyOfName<Name>> groupName) const {
+            using GroupView = typename GroupTable<Container, KeyOfName<Name>>::GroupView;
+            return GroupView(this->groupIndex.template find<Name>(), groupName);
+        }
+    };
 
-            GroupView() = default;
+    /**
+     * Ship with dimensions fixed at compile time, containers are stored inside the ship object itself
+     * and the groupings are given as NamedGrouping types like in GroupedShip
+     */
+    template<typename Container, int ShipX, int ShipY, int ShipHeight, typename... Groupings>
+    class StaticShip : public BasicShip<Container, StaticGroupIndex<Container, Groupings...>,
+            CargoArena<Container, StaticCargoStorage<Container, ShipX, ShipY, ShipHeight>>> {
+        static_assert(ShipX > 0 && ShipY > 0 && ShipHeight > 0, "ship dimensions must be positive");
 
-            auto begin() const {
-                return pGroup ? pGroup->begin() : iterType{};
-            }
+        using Base = BasicShip<Container, StaticGroupIndex<Container, Groupings...>,
+                CargoArena<Container, StaticCargoStorage<Container, ShipX, ShipY, ShipHeight>>>;
+        using Index = StaticGroupIndex<Container, Groupings...>;
 
-            auto end() const {
-                return pGroup ? pGroup->end() : iterType{};
+        template<FixedString Name>
+        using KeyOfName = typename Index::template KeyOfName<Name>;
+
+    public:
+        StaticShip() noexcept: Base(X{ShipX}, Y{ShipY}, Height{ShipHeight}) {}
+
+        explicit StaticShip(std::span<const Position> restrictions) noexcept(false): StaticShip() {
+            validateRestrictions(restrictions);
+            this->applyRestrictions(restrictions);
+        }
+
+        /**
+         * Validates the given restrictions against the ship dimensions, usable in constant expressions
+         */
+        static constexpr void validateRestrictions(std::span<const Position> restrictions) noexcept(false) {
+            std::array<bool, std::size_t(ShipX) * ShipY> restricted{};
+            for (const Position &res : restrictions) {
+                int x = std::get<0>(res), y = std::get<1>(res), height = std::get<2>(res);
+                if (x < 0 || x >= ShipX || y < 0 || y >= ShipY) {
+                    throw BadShipOperationException("received restriction with bad (x, y) value");
+                }
+                if (height < 0 || height >= ShipHeight) {
+                    throw BadShipOperationException("received restriction with bad height value");
+                }
+                if (restricted[x * ShipY + y]) {
+                    throw BadShipOperationException("received duplicate restriction for the same (x, y)");
+                }
+                restricted[x * ShipY + y] = true;
             }
-        };
+        }
+
+        /**
+         * Returns view of containers of the given group of the grouping named Name
+         */
+        template<FixedString Name>
+        auto getContainersViewByGroup(GroupKeyLookup<KeyOfName<Name>> groupName) const {
+            using GroupView = typename GroupTable<Container, KeyOfName<Name>>::GroupView;
+            return GroupView(this->groupIndex.template find<Name>(), groupName);
+        }
     };
 }
+
+template<std::size_t N>
+struct std::hash<shipping::FixedString<N>> {
+    std::size_t operator()(const shipping::FixedString<N> &str) const noexcept {
+        return std::hash<std::string_view>{}(std::string_view(str.chars, N));
+    }
+};
 #define FINAL_PROJECT_SHIP_H
 
 #endif //FINAL_PROJECT_SHIP_H
@@ -1,5 +1,7 @@
 #include <cassert>
 #include <ostream>
+#include <thread>
+#include <stdexcept>
 #include "Ship.h"
 
 using namespace shipping;
@@ -491,6 +493,1467 @@ inline void testLoadWhenThereIsNoPlace() {
     AssertException(myShip.load(X{4}, Y{4}, 3), "load to (0,0) where there is no space left")
 }
 
+inline void testShipContainerAddressStable() {
+    Ship<string> myShip{X{3}, Y{4}, Height{5}};
+
+    myShip.load(X{1}, Y{2}, "first");
+    const string *first = &*myShip.getContainersViewByPosition(X{1}, Y{2}).begin();
+
+    // fill the whole ship around it
+    for (int x = 0; x < 3; x++) {
+        for (int y = 0; y < 4; y++) {
+            while (true) {
+                try {
+                    myShip.load(X{x}, Y{y}, to_string(x) + to_string(y));
+                } catch (BadShipOperationException &e) {
+                    break;
+                }
+            }
+        }
+    }
+
+    auto view = myShip.getContainersViewByPosition(X{1}, Y{2});
+    const string *bottom = nullptr;
+    for (auto &c: view) {
+        bottom = &c;
+    }
+    AssertCondition(bottom == first, "expected bottom container of (1,2) to keep its address after filling the ship")
+    AssertEquals(*bottom, "first")
+
+    int count = 0;
+    for (auto &c: myShip) {
+        (void) c;
+        count++;
+    }
+    AssertEquals(count, 3 * 4 * 5)
+}
+
+inline void testShipIteratorSparseShip() {
+    Ship<int> myShip{X{3}, Y{64}, Height{2}};
+
+    // stacks 0, 63, 64, 127 and 191 in the occupancy bitmap - on and around word boundaries
+    myShip.load(X{0}, Y{0}, 1);
+    myShip.load(X{0}, Y{63}, 2);
+    myShip.load(X{0}, Y{63}, 3);
+    myShip.load(X{1}, Y{0}, 4);
+    myShip.load(X{1}, Y{63}, 5);
+    myShip.load(X{2}, Y{63}, 6);
+
+    vector<int> res;
+    for (int c: myShip) {
+        res.push_back(c);
+    }
+    AssertEquals(res.size(), 6)
+    for (int i = 0; i < 6; i++) {
+        AssertEquals(res[i], i + 1)
+    }
+
+    myShip.unload(X{0}, Y{0});
+    myShip.unload(X{1}, Y{63});
+    myShip.unload(X{2}, Y{63});
+    res.clear();
+    for (int c: myShip) {
+        res.push_back(c);
+    }
+    AssertEquals(res.size(), 3)
+    AssertEquals(res[0], 2)
+    AssertEquals(res[2], 4)
+}
+
+inline void testShipViewByGroupAfterManyUnloads() {
+    Grouping<int> groupingFunctions = {
+            {"modulo_3",
+                    [](const int &i) { return std::to_string(i % 3); }
+            }
+    };
+
+    Ship<int> myShip{X{3}, Y{3}, Height{4}, {}, groupingFunctions};
+
+    auto view0 = myShip.getContainersViewByGroup("modulo_3", "0");
+
+    int value = 0;
+    for (int x = 0; x < 3; x++) {
+        for (int y = 0; y < 3; y++) {
+            for (int h = 0; h < 4; h++) {
+                myShip.load(X{x}, Y{y}, value++);
+            }
+        }
+    }
+
+    // unload the two top containers of every other stack, entries get swap-removed from the middle of the groups
+    for (int x = 0; x < 3; x++) {
+        for (int y = x % 2; y < 3; y += 2) {
+            myShip.unload(X{x}, Y{y});
+            myShip.unload(X{x}, Y{y});
+        }
+    }
+
+    vector<int> expected;
+    for (int c: myShip) {
+        if (c % 3 == 0) {
+            expected.push_back(c);
+        }
+    }
+
+    ViewPair<int> pairs;
+    for (auto &pair: view0) {
+        int stackFirst = (get<0>(pair.first) * 3 + get<1>(pair.first)) * 4;
+        AssertEquals(pair.second, stackFirst + get<2>(pair.first))
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), expected.size())
+    for (size_t i = 0; i < expected.size(); i++) {
+        AssertEquals(pairs[i].second, expected[i])
+    }
+}
+
+enum class Cargo {
+    Dry, Reefer, Tank
+};
+
+inline void testShipTypedGroupingKeys() {
+    Grouping<A, int> modulo = {
+            {"modulo_10",
+                    [](const A &a) { return a.y % 10; }
+            }
+    };
+
+    Ship<A, int> myShip{X{3}, Y{3}, Height{4}, {}, modulo};
+    auto view2 = myShip.getContainersViewByGroup("modulo_10", 2);
+    myShip.load(X{0}, Y{0}, A(12));
+    myShip.load(X{0}, Y{0}, A(13));
+    myShip.load(X{1}, Y{2}, A(42));
+
+    ViewPair<A> pairs;
+    for (auto &pair: view2) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 2)
+    AssertEquals(pairs[0].second.y, 12)
+    AssertCondition((posEquals(pairs[1].first, {X(1), Y(2), Height{0}})), "Position of element is invalid")
+
+    Grouping<string, Cargo> byType = {
+            {"type",
+                    [](const string &s) { return s[0] == 'R' ? Cargo::Reefer : s[0] == 'T' ? Cargo::Tank : Cargo::Dry; }
+            }
+    };
+    Ship<string, Cargo> cargoShip{X{2}, Y{2}, Height{2}, {}, byType};
+    cargoShip.load(X{0}, Y{0}, "R1");
+    cargoShip.load(X{0}, Y{1}, "D1");
+    cargoShip.load(X{1}, Y{1}, "R2");
+    int reefers = 0;
+    for (auto &pair: cargoShip.getContainersViewByGroup("type", Cargo::Reefer)) {
+        AssertEquals(pair.second[0], 'R')
+        reefers++;
+    }
+    AssertEquals(reefers, 2)
+    cargoShip.unload(X{0}, Y{0});
+    for (auto &pair: cargoShip.getContainersViewByGroup("type", Cargo::Reefer)) {
+        AssertEquals(pair.second, "R2")
+    }
+
+    Grouping<string, FixedString<3>> byPort = {
+            {"port",
+                    [](const string &s) { return FixedString<3>(string_view(s).substr(0, 3)); }
+            }
+    };
+    Ship<string, FixedString<3>> portShip{X{2}, Y{2}, Height{2}, {}, byPort};
+    portShip.load(X{0}, Y{0}, "HFA-1");
+    portShip.load(X{0}, Y{0}, "ASH-1");
+    portShip.load(X{1}, Y{0}, "HFA-2");
+    int haifa = 0;
+    for (auto &pair: portShip.getContainersViewByGroup("port", "HFA")) {
+        AssertEquals(pair.second.substr(0, 3), "HFA")
+        haifa++;
+    }
+    AssertEquals(haifa, 2)
+}
+
+struct FirstLetter {
+    char operator()(const string &s) const {
+        return s[0];
+    }
+};
+
+inline void testGroupedShip() {
+    GroupedShip<string,
+            NamedGrouping<"first_letter", FirstLetter>,
+            NamedGrouping<"length", decltype([](const string &s) { return s.size(); })>> myShip{X{3}, Y{3}, Height{3}, {}};
+
+    auto view_h = myShip.getContainersViewByGroup<"first_letter">('h');
+    myShip.load(X{0}, Y{0}, "hello");
+    myShip.load(X{0}, Y{0}, "bye");
+    myShip.load(X{1}, Y{2}, "hi");
+    myShip.move(X{0}, Y{0}, X{2}, Y{2});
+    myShip.load(X{0}, Y{0}, "hey");
+
+    ViewPair<string> pairs;
+    for (auto &pair: view_h) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 3)
+    AssertEquals(pairs[0].second, "hello")
+    AssertCondition((posEquals(pairs[1].first, {X(0), Y(0), Height{1}})), "Position of element is invalid")
+
+    int count = 0;
+    for (auto &pair: myShip.getContainersViewByGroup<"length">(3)) {
+        AssertEquals(pair.second.size(), 3)
+        count++;
+    }
+    AssertEquals(count, 2)
+}
+
+inline void testShipViewByGroupStringView() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+
+    Ship<string> myShip{X{2}, Y{2}, Height{2}, {}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "hello");
+    myShip.load(X{1}, Y{0}, "hi");
+    myShip.load(X{1}, Y{1}, "bye");
+
+    // views that aren't null terminated, looked up without building std::string
+    string_view request = "first_letter=h;";
+    string_view groupingName = request.substr(0, 12);
+    string_view groupName = request.substr(13, 1);
+
+    int count = 0;
+    for (auto &pair: myShip.getContainersViewByGroup(groupingName, groupName)) {
+        AssertEquals(pair.second[0], 'h')
+        count++;
+    }
+    AssertEquals(count, 2)
+
+    string owned = "b";
+    count = 0;
+    for (auto &pair: myShip.getContainersViewByGroup(string("first_letter"), owned)) {
+        AssertEquals(pair.second, "bye")
+        count++;
+    }
+    AssertEquals(count, 1)
+}
+
+inline void testShipViewByGroupReclaimedGroup() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+
+    Ship<string> myShip{X{2}, Y{2}, Height{2}, {}, groupingFunctions};
+
+    // probing groups that don't exist
+    for (char c = 'a'; c <= 'z'; c++) {
+        for (auto &pair: myShip.getContainersViewByGroup("first_letter", string(1, c))) {
+            (void) pair;
+            AssertCondition(false, "expected group to be empty")
+        }
+    }
+
+    auto view_h = myShip.getContainersViewByGroup("first_letter", "h");
+    auto view_b = myShip.getContainersViewByGroup("first_letter", "b");
+    myShip.load(X{0}, Y{0}, "hello");
+    myShip.load(X{1}, Y{0}, "bye");
+    AssertEquals(view_h.begin()->second, "hello")
+
+    // group "h" gets emptied and reclaimed, then loaded again
+    myShip.unload(X{0}, Y{0});
+    AssertCondition(!(view_h.begin() != view_h.end()), "expected view of emptied group to be empty")
+    myShip.load(X{1}, Y{1}, "hi");
+
+    int count = 0;
+    for (auto &pair: view_h) {
+        AssertEquals(pair.second, "hi")
+        AssertCondition((posEquals(pair.first, {X(1), Y(1), Height{0}})), "Position of element is invalid")
+        count++;
+    }
+    AssertEquals(count, 1)
+    AssertEquals(view_b.begin()->second, "bye")
+
+    // A view bound to an existing group with a long key finds it again after the group is reclaimed and recreated
+    Grouping<string> identity = {{"name", [](const string &s) { return s; }}};
+    Ship<string> longKeys{X{2}, Y{2}, Height{2}, {}, identity};
+    string longKey = "a container name longer than the inline buffer";
+    longKeys.load(X{0}, Y{0}, longKey);
+    auto view_long = longKeys.getContainersViewByGroup("name", string_view(longKey));
+    longKeys.unload(X{0}, Y{0});
+    longKeys.load(X{1}, Y{1}, longKey);
+    AssertCondition(posEquals(view_long.begin()->first, {X(1), Y(1), Height{0}}), "Position of element is invalid")
+}
+
+inline void testShipMoveKeepsGroups() {
+    int groupingCalls = 0;
+    Grouping<A> groupingFunctions = {
+            {"modulo_10",
+                    [&groupingCalls](const A &a) {
+                        groupingCalls++;
+                        return std::to_string(a.y % 10);
+                    }
+            }
+    };
+
+    Ship<A> myShip{X{3}, Y{3}, Height{3}, {}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, A(11));
+    myShip.load(X{0}, Y{0}, A(21));
+    myShip.load(X{1}, Y{1}, A(31));
+    auto view1 = myShip.getContainersViewByGroup("modulo_10", "1");
+    AssertEquals(groupingCalls, 3)
+
+    myShip.move(X{0}, Y{0}, X{1}, Y{1});
+    myShip.move(X{1}, Y{1}, X{2}, Y{2});
+    myShip.move(X{0}, Y{0}, X{2}, Y{2});
+    AssertEquals(groupingCalls, 3)
+
+    ViewPair<A> pairs;
+    for (auto &pair: view1) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 3)
+    AssertCondition((posEquals(pairs[0].first, {X(2), Y(2), Height{1}})), "Position of element is invalid")
+    AssertCondition((posEquals(pairs[1].first, {X(2), Y(2), Height{0}})), "Position of element is invalid")
+    AssertCondition((posEquals(pairs[2].first, {X(1), Y(1), Height{0}})), "Position of element is invalid")
+
+    // the group entries refer to the containers in their new slots
+    const A *top22 = &*myShip.getContainersViewByPosition(X{2}, Y{2}).begin();
+    for (auto &pair: view1) {
+        if (posEquals(pair.first, {X(2), Y(2), Height{1}})) {
+            AssertCondition(&pair.second == top22, "expected group entry to refer to the moved container")
+        }
+    }
+    AssertEquals(myShip.unload(X{2}, Y{2}), A(11))
+    AssertEquals(myShip.unload(X{2}, Y{2}), A(21))
+}
+
+/// Heavy container payload counting its copies and moves
+struct Manifest {
+    static inline int copies = 0;
+    static inline int moves = 0;
+    vector<string> documents;
+
+    explicit Manifest(int count) : documents(count, "customs record") {}
+
+    Manifest(const Manifest &other) : documents(other.documents) {
+        copies++;
+    }
+
+    Manifest(Manifest &&other) noexcept: documents(std::move(other.documents)) {
+        moves++;
+    }
+};
+
+inline void testShipLoadUnloadWithoutCopies() {
+    Grouping<Manifest, size_t> groupingFunctions = {
+            {"documents",
+                    [](const Manifest &m) { return m.documents.size(); }
+            }
+    };
+
+    Ship<Manifest, size_t> myShip{X{2}, Y{2}, Height{3}, {}, groupingFunctions};
+
+    myShip.load(X{0}, Y{0}, Manifest(3));
+    AssertEquals(Manifest::copies, 0)
+    AssertEquals(Manifest::moves, 1)
+
+    const Manifest &emplaced = myShip.emplace(X{0}, Y{0}, 5);
+    AssertEquals(emplaced.documents.size(), 5)
+    AssertEquals(Manifest::moves, 1)
+
+    myShip.move(X{0}, Y{0}, X{1}, Y{1});
+    AssertEquals(Manifest::moves, 2)
+
+    Manifest unloaded = myShip.unload(X{1}, Y{1});
+    AssertEquals(unloaded.documents.size(), 5)
+    AssertEquals(Manifest::copies, 0)
+
+    Manifest lvalue(7);
+    myShip.load(X{1}, Y{0}, lvalue);  // explicit copy of an lvalue
+    AssertEquals(Manifest::copies, 1)
+
+    int count = 0;
+    for (auto &pair: myShip.getContainersViewByGroup("documents", 7)) {
+        AssertEquals(pair.second.documents.size(), 7)
+        count++;
+    }
+    AssertEquals(count, 1)
+}
+
+inline void testShipLoadBatch() {
+    vector<tuple<X, Y, Height>> restrictions = {
+            tuple(X{1}, Y{1}, Height{1}),
+    };
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+
+    Ship<string> myShip{X{2}, Y{2}, Height{3}, restrictions, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "base");
+    auto view_h = myShip.getContainersViewByGroup("first_letter", "h");
+
+    vector<tuple<X, Y, string>> batch = {
+            {X{1}, Y{0}, "hello"},
+            {X{0}, Y{0}, "hi"},
+            {X{1}, Y{0}, "bye"},
+            {X{0}, Y{0}, "hey"},
+    };
+    myShip.loadBatch(batch);
+
+    // batch order is kept within each stack
+    vector<string> stack00;
+    for (auto &c: myShip.getContainersViewByPosition(X{0}, Y{0})) {
+        stack00.push_back(c);
+    }
+    AssertEquals(stack00.size(), 3)
+    AssertEquals(stack00[0], "hey")
+    AssertEquals(stack00[1], "hi")
+    AssertEquals(stack00[2], "base")
+
+    ViewPair<string> pairs;
+    for (auto &pair: view_h) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 3)
+    AssertCondition((posEquals(pairs[0].first, {X(1), Y(0), Height{0}})), "Position of element is invalid")
+    AssertCondition((posEquals(pairs[1].first, {X(0), Y(0), Height{2}})), "Position of element is invalid")
+    AssertCondition((posEquals(pairs[2].first, {X(0), Y(0), Height{1}})), "Position of element is invalid")
+
+    // (1,1) has room for one container only, nothing of the batch should be loaded
+    vector<tuple<X, Y, string>> tooBig = {
+            {X{0}, Y{1}, "ok"},
+            {X{1}, Y{1}, "one"},
+            {X{1}, Y{1}, "two"},
+    };
+    AssertException(myShip.loadBatch(tooBig), "batch loads two containers to (1,1) with room for one")
+    vector<tuple<X, Y, string>> badPosition = {
+            {X{0}, Y{1}, "ok"},
+            {X{2}, Y{1}, "bad"},
+    };
+    AssertException(myShip.loadBatch(badPosition), "batch loads to invalid position (2,1)")
+
+    int count = 0;
+    for (auto &c: myShip) {
+        (void) c;
+        count++;
+    }
+    AssertEquals(count, 5)
+    AssertEquals(get<2>(tooBig[0]), "ok")
+
+    // A throwing grouping function leaves neither the batch aboard nor its groups
+    Grouping<string> picky = {
+            {"first_letter",
+                    [](const string &s) {
+                        if (s == "bad") {
+                            throw invalid_argument("no group for " + s);
+                        }
+                        return string(1, s[0]);
+                    }
+            }
+    };
+    Ship<string> pickyShip{X{2}, Y{2}, Height{3}, restrictions, picky};
+    pickyShip.load(X{0}, Y{0}, "base");
+    vector<tuple<X, Y, string>> withBad = {
+            {X{0}, Y{0}, "ok"},
+            {X{1}, Y{1}, "bad"},
+            {X{0}, Y{0}, "other"},
+    };
+    bool thrown = false;
+    try {
+        pickyShip.loadBatch(withBad);
+    } catch (const invalid_argument &) {
+        thrown = true;
+    }
+    AssertCondition(thrown, "grouping function error wasn't passed on")
+    AssertEquals(pickyShip.getContainersCountByRegion(X{0}, Y{0}, X{1}, Y{1}), 1)
+    AssertEquals(std::ranges::distance(pickyShip.getContainersViewByGroup("first_letter", "o")), 0)
+    AssertEquals(get<2>(withBad[0]), "ok")
+    AssertEquals(get<2>(withBad[1]), "bad")
+    AssertEquals(get<2>(withBad[2]), "other")
+    get<2>(withBad[1]) = "fine";
+    pickyShip.loadBatch(withBad);
+    AssertEquals(std::ranges::distance(pickyShip.getContainersViewByGroup("first_letter", "o")), 2)
+    AssertEquals(*pickyShip.getContainersViewByPosition(X{0}, Y{0}).begin(), "other")
+}
+
+inline void testShipTryOperations() {
+    vector<tuple<X, Y, Height>> restrictions = {
+            tuple(X{0}, Y{0}, Height{1}),
+    };
+
+    Ship<string> myShip{X{2}, Y{2}, Height{2}, restrictions};
+
+    AssertCondition(myShip.tryLoad(X{0}, Y{0}, "first"), "expected load to (0,0) to succeed")
+
+    string speculative = "second";
+    auto full = myShip.tryLoad(X{0}, Y{0}, std::move(speculative));
+    AssertCondition(!full, "expected load to full (0,0) to fail")
+    AssertCondition(full.error().code == ShipErrorCode::NoSpaceToLoad, "expected no space error")
+    AssertEquals(full.error().x, 0)
+    AssertEquals(full.error().message(), "Can't load container, no space left in position : (0, 0)")
+    AssertEquals(speculative, "second")  // failed load doesn't consume the container
+    AssertCondition(myShip.tryLoad(X{1}, Y{0}, std::move(speculative)), "expected load to (1,0) to succeed")
+
+    auto badY = myShip.tryLoad(X{1}, Y{5}, "bad");
+    AssertCondition(badY.error().code == ShipErrorCode::BadY, "expected bad Y error")
+    AssertEquals(badY.error().bound, 2)
+
+    auto unloaded = myShip.tryUnload(X{1}, Y{0});
+    AssertCondition(unloaded.hasValue(), "expected unload from (1,0) to succeed")
+    AssertEquals(unloaded.value(), "second")
+    AssertCondition(myShip.tryUnload(X{1}, Y{1}).error().code == ShipErrorCode::NoContainerToUnload, "expected no container error")
+
+    AssertCondition(myShip.tryMove(X{1}, Y{1}, X{0}, Y{0}).error().code == ShipErrorCode::NoContainerToMove, "expected no container error")
+    myShip.load(X{1}, Y{1}, "third");
+    auto noSpace = myShip.tryMove(X{1}, Y{1}, X{0}, Y{0});
+    AssertCondition(noSpace.error().code == ShipErrorCode::NoSpaceToMove, "expected no space error")
+    AssertEquals(noSpace.error().y, 0)
+    AssertCondition(myShip.tryMove(X{1}, Y{1}, X{0}, Y{1}), "expected move to (0,1) to succeed")
+
+    try {
+        myShip.load(X{0}, Y{0}, "fourth");
+        AssertCondition(false, "expected load to full (0,0) to throw")
+    } catch (BadShipOperationException &e) {
+        AssertEquals(string(e.what()), "Can't load container, no space left in position : (0, 0)")
+    }
+}
+
+inline void testStaticShip() {
+    using MyShip = StaticShip<string, 2, 3, 2, NamedGrouping<"first_letter", FirstLetter>>;
+    static constexpr std::array<Position, 2> restrictions = {
+            Position{X{0}, Y{0}, Height{1}},
+            Position{X{1}, Y{2}, Height{0}},
+    };
+    static_assert((MyShip::validateRestrictions(restrictions), true));
+
+    MyShip myShip{restrictions};
+    auto view_h = myShip.getContainersViewByGroup<"first_letter">('h');
+    myShip.load(X{0}, Y{0}, "hello");
+    AssertException(myShip.load(X{0}, Y{0}, "hey"), "load to restricted (0,0) with no space left")
+    AssertException(myShip.load(X{1}, Y{2}, "hey"), "load to fully restricted (1,2)")
+    AssertException(myShip.load(X{2}, Y{0}, "hey"), "load to invalid X")
+    myShip.load(X{1}, Y{1}, "bye");
+    myShip.load(X{1}, Y{1}, "hi");
+    myShip.move(X{1}, Y{1}, X{0}, Y{2});
+
+    ViewPair<string> pairs;
+    for (auto &pair: view_h) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 2)
+    AssertCondition((posEquals(pairs[1].first, {X(0), Y(2), Height{0}})), "Position of element is invalid")
+
+    int count = 0;
+    for (auto &c: myShip.getContainersViewByPosition(X{1}, Y{1})) {
+        AssertEquals(c, "bye")
+        count++;
+    }
+    AssertEquals(count, 1)
+    AssertEquals(myShip.unload(X{0}, Y{2}), "hi")
+
+    // Region counts are kept in place like the cargo
+    AssertEquals(myShip.getContainersCountByRegion(X{0}, Y{0}, X{1}, Y{2}), 2)
+    AssertEquals(myShip.getContainersCountByRegion(X{1}, Y{1}, X{1}, Y{2}), 1)
+    AssertEquals(myShip.getSpacesLeftByRegion(X{0}, Y{0}, X{1}, Y{2}), 12 - 1 - 2 - 2)
+
+    // So is the free space tree of loadAuto
+    AssertCondition(posEquals(myShip.loadAuto("hat", PlacementPolicy::BestFit), {X{1}, Y{1}, Height{1}}), "best fit picked another stack")
+    AssertCondition(posEquals(myShip.loadAuto("ham"), {X{0}, Y{1}, Height{0}}), "first fit picked another stack")
+
+    // And the layers
+    auto bottom = myShip.getContainersViewByLayer(Height{0});
+    AssertEquals(std::ranges::distance(bottom), 3)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByLayer(Height{1})), 1)
+    myShip.unload(X{0}, Y{1});
+    AssertEquals(std::ranges::distance(bottom), 2)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByLayers()), 3)
+
+    std::array<Position, 1> badHeight = {Position{X{0}, Y{0}, Height{2}}};
+    AssertException(MyShip{badHeight}, "restriction height equal to ship height")
+    std::array<Position, 2> duplicate = {Position{X{0}, Y{0}, Height{1}}, Position{X{0}, Y{0}, Height{0}}};
+    AssertException(MyShip{duplicate}, "duplicate restriction")
+}
+
+inline void testCopyOnWriteShipClone() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+
+    CopyOnWriteShip<string> original{X{2}, Y{2}, Height{3}, {}, groupingFunctions};
+    original.load(X{0}, Y{0}, "hello");
+    original.load(X{0}, Y{0}, "bye");
+    original.load(X{1}, Y{1}, "hi");
+
+    auto plan = original.clone();
+    // Untouched stacks are shared
+    AssertCondition(&*original.getContainersViewByPosition(X{1}, Y{1}).begin() == &*plan.getContainersViewByPosition(X{1}, Y{1}).begin(),
+                    "expected clone to share stack (1,1)")
+
+    plan.move(X{0}, Y{0}, X{1}, Y{0});
+    plan.load(X{1}, Y{0}, "hey");
+    AssertEquals(plan.unload(X{1}, Y{1}), "hi")
+
+    int count = 0;
+    for (auto &pair: plan.getContainersViewByGroup("first_letter", "h")) {
+        AssertCondition((pair.first != Position{X{1}, Y{1}, Height{0}}), "unloaded container still in clone group")
+        count++;
+    }
+    AssertEquals(count, 2)
+
+    ViewPair<string> pairs;
+    for (auto &pair: original.getContainersViewByGroup("first_letter", "h")) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 2)
+    AssertEquals(pairs[0].second, "hello")
+    AssertCondition((posEquals(pairs[1].first, {X(1), Y(1), Height{0}})), "Position of element is invalid")
+    AssertEquals(*original.getContainersViewByPosition(X{0}, Y{0}).begin(), "bye")
+
+    // Changing the origin after the clone changed doesn't affect the clone, and the clone outlives the origin
+    auto second = plan.clone();
+    {
+        auto origin = original.clone();
+        origin.unload(X{0}, Y{0});
+        origin.unload(X{0}, Y{0});
+    }
+    plan.load(X{0}, Y{0}, "hat");
+    AssertEquals(*plan.getContainersViewByPosition(X{0}, Y{0}).begin(), "hat")
+    AssertEquals(*second.getContainersViewByPosition(X{0}, Y{0}).begin(), "hello")
+    count = 0;
+    for (auto &c: second) {
+        (void) c;
+        count++;
+    }
+    AssertEquals(count, 3)
+    ViewPair<string> secondPairs;
+    for (auto &pair: second.getContainersViewByGroup("first_letter", "h")) {
+        secondPairs.push_back(pair);
+    }
+    sortPairs(secondPairs);
+    AssertEquals(secondPairs.size(), 2)
+    AssertEquals(secondPairs[0].second, "hello")
+    AssertEquals(secondPairs[1].second, "hey")
+}
+
+inline void testShipMoveKeepsViews() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    static_assert(std::is_nothrow_move_constructible_v<Ship<string>>);
+    static_assert(!std::is_copy_constructible_v<StaticShip<string, 1, 1, 1>>);
+
+    vector<Ship<string>> fleet;
+    fleet.emplace_back(X{2}, Y{2}, Height{2}, vector<Position>{}, groupingFunctions);
+    fleet[0].load(X{0}, Y{0}, "hello");
+    auto view_h = fleet[0].getContainersViewByGroup("first_letter", "h");
+    auto view00 = fleet[0].getContainersViewByPosition(X{0}, Y{0});
+    const string *hello = &*view00.begin();
+    auto cargo = fleet[0].getCargoView();
+    auto bay0 = fleet[0].getContainersViewByBay(X{0});
+
+    fleet.emplace_back(X{1}, Y{1}, Height{1});  // reallocates, moving the first ship
+    Ship<string> moved = std::move(fleet[0]);
+    moved.load(X{0}, Y{0}, "hi");
+    int count = 0;
+    bool foundHello = false;
+    for (auto &pair: view_h) {
+        foundHello |= &pair.second == hello;
+        count++;
+    }
+    AssertEquals(count, 2)
+    AssertCondition(foundHello, "moved container changed its address")
+    AssertEquals(*view00.begin(), "hi")
+    AssertEquals(std::ranges::distance(cargo), 2)
+    AssertEquals(std::ranges::distance(cargo.withPositions()), 2)
+    AssertEquals(*bay0.begin(), "hello")
+    AssertEquals(std::ranges::distance(bay0), 2)
+    AssertEquals(std::ranges::distance(fleet[0].getCargoView()), 0)
+
+    // A copy has its own containers and groups
+    Ship<string> copy = moved;
+    copy.unload(X{0}, Y{0});
+    copy.load(X{1}, Y{1}, "hat");
+    count = 0;
+    for (auto &pair: copy.getContainersViewByGroup("first_letter", "h")) {
+        AssertCondition(&pair.second != hello, "copy group refers to the original container")
+        count++;
+    }
+    AssertEquals(count, 2)
+    AssertEquals(*view00.begin(), "hi")
+
+    fleet[1] = std::move(copy);
+    AssertEquals(*fleet[1].getContainersViewByPosition(X{1}, Y{1}).begin(), "hat")
+}
+
+inline void testShipContainerIds() {
+    Ship<string> myShip{X{2}, Y{2}, Height{3}};
+    ContainerId hello = myShip.load(X{0}, Y{0}, "hello");
+    ContainerId bye = myShip.load(X{0}, Y{0}, "bye");
+    ContainerId hi = myShip.load(X{1}, Y{1}, "hi");
+
+    AssertCondition((posEquals(*myShip.locate(hello), {X(0), Y(0), Height{0}})), "Position of element is invalid")
+    myShip.move(X{0}, Y{0}, X{1}, Y{1});
+    AssertCondition((posEquals(*myShip.locate(bye), {X(1), Y(1), Height{1}})), "Position of element is invalid")
+    AssertCondition(*myShip.idAt(X{1}, Y{1}, Height{0}) == hi, "expected hi at (1,1,0)")
+    AssertCondition(!myShip.idAt(X{1}, Y{1}, Height{2}), "expected no container at (1,1,2)")
+
+    auto buried = myShip.tryUnload(hi);
+    AssertCondition(buried.error().code == ShipErrorCode::ContainerNotOnTop, "expected not on top error")
+    AssertEquals(buried.error().x, 1)
+    AssertEquals(myShip.unload(bye), "bye")
+    AssertEquals(myShip.unload(hi), "hi")
+    AssertCondition(!myShip.locate(hi), "unloaded container still located")
+    AssertException(myShip.unload(hi), "unload of an unloaded container")
+
+    // The index of an unloaded container is reused, its old id stays unknown
+    ContainerId hat = myShip.load(X{0}, Y{1}, "hat");
+    AssertCondition(!(hat == hi) && !(hat == bye), "reused id equals a stale id")
+    AssertCondition(!myShip.locate(bye), "stale id located")
+
+    Ship<string> copy = myShip;
+    AssertEquals(copy.unload(hat), "hat")
+    AssertCondition(myShip.locate(hat).has_value(), "unload from copy changed the original")
+
+    CopyOnWriteShip<string> original{X{2}, Y{2}, Height{2}};
+    ContainerId first = original.load(X{1}, Y{0}, "first");
+    auto plan = original.clone();
+    plan.move(X{1}, Y{0}, X{0}, Y{1});
+    AssertCondition((posEquals(*plan.locate(first), {X(0), Y(1), Height{0}})), "Position of element is invalid")
+    AssertCondition((posEquals(*original.locate(first), {X(1), Y(0), Height{0}})), "Position of element is invalid")
+    AssertEquals(plan.unload(first), "first")
+    AssertCondition(original.locate(first).has_value(), "unload from clone changed the original")
+
+    // Ids spanning several chunks of the id table stay apart in a clone
+    CopyOnWriteShip<int> big{X{10}, Y{10}, Height{100}};
+    vector<ContainerId> bigIds;
+    for (int i = 0; i < 10000; ++i) {
+        bigIds.push_back(big.load(X{i % 10}, Y{i / 10 % 10}, i));
+    }
+    auto bigPlan = big.clone();
+    bigPlan.unload(X{0}, Y{0});
+    bigPlan.move(X{9}, Y{9}, X{0}, Y{0});
+    AssertCondition(!bigPlan.locate(bigIds[9900]), "unloaded container still located")
+    AssertCondition((posEquals(*bigPlan.locate(bigIds[9999]), {X(0), Y(0), Height{99}})), "Position of element is invalid")
+    AssertCondition((posEquals(*big.locate(bigIds[9900]), {X(0), Y(0), Height{99}})), "unload from clone changed the original")
+    AssertCondition((posEquals(*big.locate(bigIds[9999]), {X(9), Y(9), Height{99}})), "move in clone changed the original")
+}
+
+inline void testConcurrentShip() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    constexpr int cranes = 4, rounds = 200;
+    ConcurrentShip<string> myShip{X{cranes}, Y{3}, Height{rounds}, {}, groupingFunctions};
+
+    // Every crane works its own bay and moves containers into the next crane's bay, so moves cross stripes both ways
+    vector<thread> threads;
+    for (int crane = 0; crane < cranes; ++crane) {
+        threads.emplace_back([&myShip, crane] {
+            for (int i = 0; i < rounds; ++i) {
+                string name = (i % 2 ? "h" : "b") + to_string(crane) + "-" + to_string(i);
+                ContainerId id = myShip.load(X{crane}, Y{0}, name);
+                myShip.load(X{crane}, Y{1}, name);
+                myShip.move(X{crane}, Y{1}, X{(crane + 1) % cranes}, Y{2});
+                if (i % 4 == 0) {
+                    myShip.unload(id);
+                }
+            }
+        });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+
+    int count = 0;
+    for (auto &c: myShip) {
+        (void) c;
+        count++;
+    }
+    AssertEquals(count, cranes * (2 * rounds - rounds / 4))
+
+    int hCount = 0;
+    for (auto &pair: myShip.getContainersViewByGroup("first_letter", "h")) {
+        AssertCondition(pair.second[0] == 'h', "container in wrong group")
+        hCount++;
+    }
+    AssertEquals(hCount, cranes * rounds)
+
+    count = 0;
+    for (auto &c: myShip.getContainersViewByPosition(X{1}, Y{2})) {
+        AssertEquals(c.substr(1, 2), "0-")
+        count++;
+    }
+    AssertEquals(count, rounds)
+
+    // Many groups spread over all shards, whose entries share one membership per slot
+    Grouping<string> byNumber = {
+            {"number", [](const string &s) { return to_string(stoi(s) % 40); }}
+    };
+    ConcurrentShip<string> numbered{X{cranes}, Y{2}, Height{rounds}, {}, byNumber};
+    vector<vector<ContainerId>> unloadedIds(cranes), keptIds(cranes);
+    threads.clear();
+    for (int crane = 0; crane < cranes; ++crane) {
+        threads.emplace_back([&, crane] {
+            for (int i = 0; i < rounds; ++i) {
+                ContainerId id = numbered.load(X{crane}, Y{0}, to_string(i));
+                keptIds[crane].push_back(numbered.load(X{crane}, Y{1}, to_string(i)));
+                if (i % 3 == 0) {
+                    numbered.unload(id);
+                    unloadedIds[crane].push_back(id);
+                }
+            }
+        });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+    int grouped = 0;
+    for (int number = 0; number < 40; ++number) {
+        for (auto &[pos, c]: numbered.getContainersViewByGroup("number", to_string(number))) {
+            AssertEquals(stoi(c) % 40, number)
+            auto stack = numbered.getContainersViewByPosition(get<0>(pos), get<1>(pos));
+            AssertEquals(*(stack.begin() + (ranges::distance(stack) - 1 - get<2>(pos))), c) // Stacks are viewed top to bottom
+            grouped++;
+        }
+    }
+    AssertEquals(grouped, cranes * (2 * rounds - (rounds + 2) / 3))
+
+    // Ids are taken from one lock-free table by all cranes, freed ones are reused and stale ids aren't found
+    for (int crane = 0; crane < cranes; ++crane) {
+        for (ContainerId id: unloadedIds[crane]) {
+            AssertCondition(!numbered.locate(id), "stale id found")
+        }
+        for (int i = 0; i < rounds; ++i) {
+            auto pos = numbered.locate(keptIds[crane][i]);
+            AssertCondition((pos && posEquals(*pos, {X{crane}, Y{1}, Height{i}})), "id of a loaded container not found")
+        }
+    }
+}
+
+inline void testConcurrentShipSnapshot() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    ConcurrentShip<string> myShip{X{4}, Y{2}, Height{40}, {}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "hello");
+    myShip.load(X{0}, Y{0}, "bye");
+
+    auto before = myShip.snapshot();
+    myShip.unload(X{0}, Y{0});
+    myShip.load(X{0}, Y{0}, "hat");
+    myShip.load(X{1}, Y{1}, "hi");
+    AssertEquals(*before.getContainersViewByPosition(X{0}, Y{0}).begin(), "bye")
+    AssertEquals(before.getContainersViewByGroup("first_letter", "h").size(), 1)
+    AssertEquals(myShip.snapshot().getContainersViewByGroup("first_letter", "h").size(), 3)
+
+    // Cranes only move containers around while a monitor checks every snapshot holds all of them
+    for (int i = 0; i < 20; ++i) {
+        myShip.load(X{i % 4}, Y{1}, "h" + to_string(i));
+    }
+    std::atomic<bool> done = false;
+    vector<thread> cranes;
+    for (int crane = 0; crane < 4; ++crane) {
+        cranes.emplace_back([&myShip, crane] {
+            for (int i = 0; i < 300; ++i) {
+                myShip.tryMove(X{crane}, Y{i % 2}, X{(crane + i) % 4}, Y{(i / 2) % 2});
+            }
+        });
+    }
+    int snapshots = 0;
+    bool consistent = true;
+    std::thread monitor([&] {
+        do {
+            auto snapshot = myShip.snapshot();
+            int count = 0;
+            for (auto &c: snapshot) {
+                (void) c;
+                count++;
+            }
+            consistent &= count == 23 && snapshot.getContainersViewByGroup("first_letter", "h").size() == 23;
+            snapshots++;
+        } while (!done);
+    });
+    for (auto &t: cranes) {
+        t.join();
+    }
+    done = true;
+    monitor.join();
+    AssertCondition(consistent, "snapshot taken while cranes move containers isn't consistent")
+    AssertCondition(snapshots > 0, "monitor took no snapshot")
+    AssertEquals(*before.getContainersViewByPosition(X{0}, Y{0}).begin(), "bye")
+
+    // Snapshots are forward ranges and their iterators know the positions
+    static_assert(std::ranges::forward_range<ShipSnapshot<string, string>>);
+    AssertEquals(std::ranges::distance(before), 2)
+    auto itr = std::ranges::find(before, string("bye"));
+    AssertCondition((posEquals(itr.position(), {X{0}, Y{0}, Height{1}})), "Position of element is invalid")
+}
+
+inline void testShipLoadBatchParallelGroups() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            },
+            {"length",
+                    [](const string &s) { return to_string(s.size()); }
+            }
+    };
+    Ship<string> batchShip{X{10}, Y{10}, Height{50}, {}, groupingFunctions};
+    Ship<string> serialShip{X{10}, Y{10}, Height{50}, {}, groupingFunctions};
+
+    vector<tuple<X, Y, string>> batch;
+    for (int i = 0; i < 5000; ++i) {
+        batch.emplace_back(X{i % 10}, Y{i / 10 % 10}, string(1, char('a' + i % 7)) + to_string(i));
+    }
+    // loadBatch loads stack by stack keeping batch order in every stack, the serial ship follows the same order
+    for (int stack = 0; stack < 100; ++stack) {
+        for (int i = 0; i < 5000; ++i) {
+            auto &[x, y, name] = batch[i];
+            if (x * 10 + y == stack) {
+                serialShip.load(x, y, name);
+            }
+        }
+    }
+    batchShip.loadBatch(batch);
+
+    for (string key: {"a", "d", "g"}) {
+        auto batchView = batchShip.getContainersViewByGroup("first_letter", key);
+        auto serialView = serialShip.getContainersViewByGroup("first_letter", key);
+        auto serialItr = serialView.begin();
+        int count = 0;
+        for (auto &pair: batchView) {
+            AssertCondition(serialItr != serialView.end(), "batch group has more containers than serial group")
+            AssertEquals(pair.second, serialItr->second)
+            AssertCondition((posEquals(pair.first, serialItr->first)), "Position of element is invalid")
+            ++serialItr;
+            count++;
+        }
+        AssertCondition(serialItr == serialView.end(), "batch group has less containers than serial group")
+        AssertCondition(count > 700, "group is missing containers")
+    }
+    int count = 0;
+    for (auto &pair: batchShip.getContainersViewByGroup("length", "4")) {
+        AssertEquals(pair.second.size(), 4)
+        count++;
+    }
+    AssertEquals(count, 900)
+}
+
+inline void testShipParallelForEach() {
+    Ship<string> myShip{X{40}, Y{30}, Height{100}, {{X{3}, Y{4}, Height{0}}}};
+    vector<tuple<X, Y, string>> batch;
+    long long expected = 0;
+    for (int i = 0; i < 100000; ++i) {
+        if (i % 1200 != 3 * 30 + 4) {
+            batch.emplace_back(X{i % 1200 / 30}, Y{i % 30}, to_string(i));
+            expected += i;
+        }
+    }
+    myShip.loadBatch(batch);
+
+    atomic<long long> parallelSum = 0, sequencedSum = 0;
+    atomic<int> parallelCount = 0;
+    myShip.parallelForEach(ExecutionPolicy::Parallel, [&](const string &c) {
+        parallelSum += stoll(c);
+        parallelCount++;
+    });
+    myShip.parallelForEach(ExecutionPolicy::Sequenced, [&](const string &c) { sequencedSum += stoll(c); });
+    AssertEquals(parallelCount.load(), int(batch.size()))
+    AssertEquals(parallelSum.load(), expected)
+    AssertEquals(sequencedSum.load(), expected)
+
+    // Bays cover the ship and bad bays are empty
+    int bayTotal = 0;
+    for (int x = 0; x < 40; ++x) {
+        for (auto &c: myShip.getContainersViewByBay(X{x})) {
+            AssertEquals(stoll(c) % 1200 / 30, x)
+            bayTotal++;
+        }
+    }
+    AssertEquals(bayTotal, int(batch.size()))
+    for ([[maybe_unused]] auto &c: myShip.getContainersViewByBay(X{40})) {
+        AssertCondition(false, "bad bay isn't empty")
+    }
+
+    // Splitting keeps every container exactly once
+    auto [left, right] = myShip.getCargoView().split();
+    int splitCount = 0;
+    for (auto &range: {left, right}) {
+        for ([[maybe_unused]] auto &c: range) {
+            splitCount++;
+        }
+    }
+    AssertEquals(splitCount, int(batch.size()))
+    AssertEquals(left.stackCount() + right.stackCount(), 1200)
+}
+
+inline void testShipRanges() {
+    using MyShip = Ship<string>;
+    static_assert(std::forward_iterator<MyShip::ShipCargoIterator>);
+    static_assert(std::forward_iterator<MyShip::PositionedCargoIterator>);
+    static_assert(std::ranges::forward_range<const MyShip>);
+    static_assert(std::ranges::view<MyShip::CargoRange> && std::ranges::forward_range<MyShip::CargoRange>);
+    static_assert(std::ranges::view<MyShip::PositionView> && std::ranges::forward_range<MyShip::PositionView>);
+    static_assert(std::ranges::view<MyShip::GroupView> && std::ranges::forward_range<MyShip::GroupView>);
+
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    MyShip myShip{X{4}, Y{3}, Height{5}, {{X{1}, Y{1}, Height{2}}}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "a1");
+    myShip.load(X{0}, Y{0}, "b2");
+    myShip.load(X{1}, Y{1}, "a3");
+    myShip.load(X{3}, Y{2}, "c4");
+    myShip.load(X{3}, Y{2}, "a5");
+
+    // Positions come from the iteration order itself
+    ViewPair<string> expected = {{{X{0}, Y{0}, Height{0}}, "a1"}, {{X{0}, Y{0}, Height{1}}, "b2"},
+                                 {{X{1}, Y{1}, Height{0}}, "a3"}, {{X{3}, Y{2}, Height{0}}, "c4"},
+                                 {{X{3}, Y{2}, Height{1}}, "a5"}};
+    ViewPair<string> actual;
+    for (auto [pos, container]: myShip.getContainersViewWithPositions()) {
+        actual.emplace_back(pos, container);
+    }
+    AssertEquals(actual.size(), expected.size())
+    for (size_t i = 0; i < actual.size(); ++i) {
+        AssertCondition(posEquals(actual[i].first, expected[i].first), "Position of element is invalid")
+        AssertEquals(actual[i].second, expected[i].second)
+    }
+
+    // Pipelines run over the ship and its views without copies
+    auto onlyA = [](const string &c) { return c[0] == 'a'; };
+    vector<const string *> filtered;
+    for (auto &c: myShip | std::views::filter(onlyA)) {
+        filtered.push_back(&c);
+    }
+    AssertEquals(filtered.size(), 3)
+    AssertCondition(*filtered[2] == "a5" && &*std::ranges::next(myShip.begin(), 4) == filtered[2], "filter copied containers")
+
+    auto heights = myShip.getContainersViewWithPositions()
+                   | std::views::filter([](const auto &entry) { return entry.second[0] != 'b'; })
+                   | std::views::transform([](const auto &entry) { return int(std::get<2>(entry.first)); });
+    AssertEquals(std::ranges::distance(heights), 4)
+    AssertEquals(*std::ranges::max_element(heights), 1)
+
+    auto position = myShip.getContainersViewByPosition(X{0}, Y{0}) | std::views::transform([](const string &c) { return c.size(); });
+    AssertEquals(std::ranges::distance(position), 2)
+    auto group = myShip.getContainersViewByGroup("first_letter", "a") | std::views::filter([](const auto &entry) { return std::get<0>(entry.first) == 3; });
+    AssertEquals(std::ranges::distance(group), 1)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByBay(X{3}) | std::views::filter(onlyA)), 1)
+}
+
+inline void testShipGroupStats() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    Ship<string> myShip{X{4}, Y{4}, Height{5}, {}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "a10");
+    myShip.load(X{0}, Y{0}, "a30");
+    myShip.load(X{1}, Y{0}, "b7");
+
+    // Containers loaded before the aggregate is registered are aggregated too
+    myShip.registerAggregate("weight", [](const string &c) { return stod(c.substr(1)); });
+    myShip.load(X{1}, Y{1}, "a20");
+    vector<tuple<X, Y, string>> batch = {{X{2}, Y{2}, "a5"}, {X{2}, Y{2}, "b9"}};
+    myShip.loadBatch(batch);
+
+    auto stats = myShip.groupStats("first_letter", "a");
+    AssertEquals(stats.count(), 4)
+    AssertEquals(stats.aggregate("weight")->sum, 65)
+    AssertEquals(stats.aggregate("weight")->min, 5)
+    AssertEquals(stats.aggregate("weight")->max, 30)
+    AssertCondition(!stats.aggregate("volume"), "unknown aggregate has stats")
+    AssertEquals(myShip.groupStats("first_letter", "b").aggregate("weight")->max, 9)
+
+    // Unloading the maximum and moving keep the stats up to date
+    myShip.unload(X{0}, Y{0});
+    myShip.move(X{2}, Y{2}, X{3}, Y{3});
+    stats = myShip.groupStats("first_letter", "a");
+    AssertEquals(stats.count(), 3)
+    AssertEquals(stats.aggregate("weight")->sum, 35)
+    AssertEquals(stats.aggregate("weight")->max, 20)
+    AssertEquals(myShip.groupStats("first_letter", "b").count(), 2)
+
+    myShip.unload(X{3}, Y{3});
+    myShip.unload(X{1}, Y{0});
+    AssertEquals(myShip.groupStats("first_letter", "b").count(), 0)
+    AssertCondition(!myShip.groupStats("first_letter", "b").aggregate("weight"), "empty group has stats")
+    AssertEquals(myShip.groupStats("no_such_grouping", "a").count(), 0)
+
+    // Copies of a copy-on-write ship keep their own stats
+    CopyOnWriteShip<string> cowShip{X{2}, Y{2}, Height{3}, {}, groupingFunctions};
+    cowShip.registerAggregate("weight", [](const string &c) { return stod(c.substr(1)); });
+    cowShip.load(X{0}, Y{0}, "a1");
+    auto clone = cowShip.clone();
+    clone.load(X{0}, Y{1}, "a2");
+    AssertEquals(cowShip.groupStats("first_letter", "a").aggregate("weight")->sum, 1)
+    AssertEquals(clone.groupStats("first_letter", "a").aggregate("weight")->sum, 3)
+}
+
+inline void testShipGroupQuery() {
+    Grouping<string> groupingFunctions = {
+            {"port",
+                    [](const string &s) { return s.substr(0, s.find('-')); }
+            },
+            {"type",
+                    [](const string &s) { return s.substr(s.find('-') + 1); }
+            }
+    };
+    using Query = Ship<string>::Query;
+    Ship<string> myShip{X{5}, Y{5}, Height{4}, {{X{0}, Y{1}, Height{1}}}, groupingFunctions};
+    myShip.load(X{0}, Y{0}, "haifa-reefer");
+    myShip.load(X{0}, Y{0}, "haifa-dry");
+    myShip.load(X{2}, Y{3}, "ashdod-reefer");
+    myShip.load(X{4}, Y{4}, "haifa-reefer");
+    myShip.load(X{4}, Y{4}, "eilat-tank");
+
+    auto matches = myShip.query(Query::group("port", "haifa") & Query::group("type", "reefer"));
+    ViewPair<string> actual;
+    for (auto [pos, container]: matches) {
+        actual.emplace_back(pos, container);
+    }
+    AssertEquals(actual.size(), 2)
+    AssertCondition(posEquals(actual[0].first, {X{0}, Y{0}, Height{0}}), "Position of element is invalid")
+    AssertCondition(posEquals(actual[1].first, {X{4}, Y{4}, Height{0}}), "Position of element is invalid")
+    AssertEquals(actual[1].second, "haifa-reefer")
+    AssertEquals(matches.count(), 2)
+
+    AssertEquals(myShip.query(Query::group("port", "haifa") | Query::group("type", "reefer")).count(), 4)
+    AssertEquals(myShip.query(~Query::group("port", "haifa")).count(), 2)
+    AssertEquals(myShip.query(Query::group("type", "reefer") & ~Query::group("port", "haifa")).count(), 1)
+    AssertEquals(myShip.query(Query::group("port", "tel aviv") | Query::group("colour", "red")).count(), 0)
+    AssertEquals(std::ranges::distance(myShip.query(~Query::group("type", "dry"))), 4)
+
+    // Queries see the ship as it is when they run
+    myShip.move(X{0}, Y{0}, X{1}, Y{1});
+    myShip.unload(X{2}, Y{3});
+    for (auto [pos, container]: myShip.query(Query::group("type", "dry") | Query::group("type", "reefer"))) {
+        AssertCondition(posEquals(pos, {X{0}, Y{0}, Height{0}}) || posEquals(pos, {X{1}, Y{1}, Height{0}}) ||
+                        posEquals(pos, {X{4}, Y{4}, Height{0}}), "Position of element is invalid")
+    }
+    AssertEquals(myShip.query(Query::group("type", "dry") | Query::group("type", "reefer")).count(), 3)
+
+    // Containers unloaded after the query ran are skipped
+    auto reefers = myShip.query(Query::group("type", "reefer"));
+    myShip.unload(X{4}, Y{4});
+    myShip.unload(X{4}, Y{4});
+    myShip.unload(X{0}, Y{0});
+    AssertEquals(std::ranges::distance(reefers), 0)
+
+    // Queries follow a moved ship
+    auto haifa = myShip.query(Query::group("port", "haifa"));
+    Ship<string> moved = std::move(myShip);
+    moved.load(X{1}, Y{1}, "eilat-dry");
+    AssertEquals(std::ranges::distance(haifa), 1)
+    for (auto [pos, container]: haifa) {
+        AssertCondition(posEquals(pos, {X{1}, Y{1}, Height{0}}), "Position of element is invalid")
+        AssertEquals(container, "haifa-dry")
+    }
+
+    CopyOnWriteShip<string> plan{X{2}, Y{2}, Height{2}, {}, groupingFunctions};
+    plan.load(X{0}, Y{1}, "haifa-dry");
+    plan.load(X{1}, Y{0}, "haifa-reefer");
+    auto planned = plan.query(CopyOnWriteShip<string>::Query::group("port", "haifa"));
+    vector<CopyOnWriteShip<string>> fleet;
+    fleet.push_back(std::move(plan));
+    fleet.push_back(fleet[0].clone());
+    fleet[0].unload(X{1}, Y{0});
+    AssertEquals(std::ranges::distance(planned), 1)
+    AssertEquals(std::ranges::distance(fleet[1].query(CopyOnWriteShip<string>::Query::group("port", "haifa"))), 2)
+}
+
+inline void testShipRegions() {
+    Ship<int> myShip{X{6}, Y{5}, Height{4}, {{X{2}, Y{2}, Height{1}}, {X{5}, Y{4}, Height{0}}}};
+    int value = 0;
+    for (int x = 0; x < 6; ++x) {
+        for (int y = 0; y < 5; ++y) {
+            for (int h = 0; h < (x + y) % 3 && myShip.tryLoad(X{x}, Y{y}, value); ++h) {
+                ++value;
+            }
+        }
+    }
+
+    // Region view yields the containers of every stack in the rectangle, bay by bay and bottom up
+    vector<int> expected, actual;
+    for (int x = 1; x <= 3; ++x) {
+        for (int y = 1; y <= 3; ++y) {
+            for (auto itr = myShip.getContainersViewByPosition(X{x}, Y{y}).end(); itr != myShip.getContainersViewByPosition(X{x}, Y{y}).begin();) {
+                expected.push_back(*--itr);
+            }
+        }
+    }
+    for (int c: myShip.getContainersViewByRegion(X{1}, Y{1}, X{3}, Y{3})) {
+        actual.push_back(c);
+    }
+    AssertCondition(actual == expected, "region view has other containers")
+    AssertEquals(myShip.getContainersCountByRegion(X{1}, Y{1}, X{3}, Y{3}), int(expected.size()))
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByRegion(X{0}, Y{0}, X{5}, Y{4})), value)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByRegion(X{3}, Y{0}, X{1}, Y{4})), 0)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByRegion(X{0}, Y{0}, X{6}, Y{4})), 0)
+
+    // Counts and free space follow loads, unloads and moves
+    AssertEquals(myShip.getContainersCountByRegion(X{0}, Y{0}, X{5}, Y{4}), value)
+    AssertEquals(myShip.getSpacesLeftByRegion(X{0}, Y{0}, X{5}, Y{4}), 6 * 5 * 4 - 3 - 4 - value)
+    AssertEquals(myShip.getSpacesLeftByRegion(X{2}, Y{2}, X{2}, Y{2}), 0)
+    myShip.unload(X{2}, Y{3});
+    myShip.move(X{1}, Y{1}, X{4}, Y{4});
+    myShip.load(X{0}, Y{0}, 100);
+    AssertEquals(myShip.getContainersCountByRegion(X{0}, Y{0}, X{5}, Y{4}), value)
+    AssertEquals(myShip.getContainersCountByRegion(X{4}, Y{4}, X{4}, Y{4}), 3)
+    AssertEquals(myShip.getContainersCountByRegion(X{0}, Y{0}, X{2}, Y{4}), myShip.getContainersCountByRegion(X{0}, Y{0}, X{1}, Y{4}) +
+                                                                        myShip.getContainersCountByRegion(X{2}, Y{0}, X{2}, Y{4}))
+    AssertEquals(myShip.getSpacesLeftByRegion(X{4}, Y{4}, X{5}, Y{4}), 1)
+    AssertEquals(myShip.getContainersCountByRegion(X{0}, Y{0}, X{9}, Y{9}), 0)
+
+    Ship<int> copy = myShip;
+    copy.unload(X{4}, Y{4});
+    AssertEquals(copy.getContainersCountByRegion(X{4}, Y{4}, X{4}, Y{4}), 2)
+    AssertEquals(myShip.getContainersCountByRegion(X{4}, Y{4}, X{4}, Y{4}), 3)
+
+    // Region views follow a moved ship
+    auto region = myShip.getContainersViewByRegion(X{4}, Y{4}, X{5}, Y{4});
+    Ship<int> moved = std::move(myShip);
+    moved.load(X{4}, Y{4}, 200);
+    AssertEquals(std::ranges::distance(region), 4)
+
+    // Ships cloned in O(1) count regions by scanning them
+    CopyOnWriteShip<int> plan{X{3}, Y{3}, Height{2}, {{X{1}, Y{1}, Height{1}}}};
+    plan.load(X{1}, Y{1}, 1);
+    plan.load(X{2}, Y{1}, 2);
+    auto clone = plan.clone();
+    clone.load(X{1}, Y{2}, 3);
+    AssertEquals(plan.getContainersCountByRegion(X{1}, Y{1}, X{2}, Y{2}), 2)
+    AssertEquals(clone.getContainersCountByRegion(X{1}, Y{1}, X{2}, Y{2}), 3)
+    AssertEquals(clone.getSpacesLeftByRegion(X{1}, Y{1}, X{2}, Y{2}), 4)
+    AssertEquals(std::ranges::distance(clone.getContainersViewByRegion(X{0}, Y{1}, X{2}, Y{2})), 3)
+}
+
+inline void testShipLoadAuto() {
+    // Stack capacities, (x, y) order: (0,0)=3 (0,1)=1 (1,0)=0 (1,1)=2 (2,0)=3 (2,1)=3
+    vector<Position> restrictions = {{X{0}, Y{1}, Height{1}}, {X{1}, Y{0}, Height{0}}, {X{1}, Y{1}, Height{2}}};
+    auto at = [](int x, int y, int h) { return Position{X{x}, Y{y}, Height{h}}; };
+
+    Ship<string> firstFit{X{3}, Y{2}, Height{3}, restrictions};
+    AssertCondition(posEquals(firstFit.loadAuto("a"), at(0, 0, 0)), "first fit picked another stack")
+    firstFit.load(X{0}, Y{0}, "b");
+    firstFit.load(X{0}, Y{0}, "c");
+    AssertCondition(posEquals(firstFit.loadAuto("d", PlacementPolicy::FirstFit), at(0, 1, 0)), "first fit picked another stack")
+    AssertCondition(posEquals(firstFit.loadAuto("e"), at(1, 1, 0)), "first fit skipped the restricted stack badly")
+    firstFit.unload(X{0}, Y{0});
+    AssertCondition(posEquals(firstFit.loadAuto("f"), at(0, 0, 2)), "first fit didn't reuse the freed slot")
+
+    Ship<string> bestFit{X{3}, Y{2}, Height{3}, restrictions};
+    AssertCondition(posEquals(bestFit.loadAuto("a", PlacementPolicy::BestFit), at(0, 1, 0)), "best fit picked another stack")
+    AssertCondition(posEquals(bestFit.loadAuto("b", PlacementPolicy::BestFit), at(1, 1, 0)), "best fit picked another stack")
+    AssertCondition(posEquals(bestFit.loadAuto("c", PlacementPolicy::BestFit), at(1, 1, 1)), "best fit picked another stack")
+    AssertCondition(posEquals(bestFit.loadAuto("d", PlacementPolicy::BestFit), at(0, 0, 0)), "best fit picked another stack")
+    AssertCondition(posEquals(bestFit.loadAuto("e", PlacementPolicy::BestFit), at(0, 0, 1)), "best fit picked another stack")
+
+    Ship<string> lowest{X{3}, Y{2}, Height{3}, restrictions};
+    lowest.load(X{0}, Y{0}, "a");
+    lowest.load(X{0}, Y{1}, "b");
+    AssertCondition(posEquals(lowest.loadAuto("c", PlacementPolicy::LowestStack), at(1, 1, 0)), "lowest stack picked another stack")
+    AssertCondition(posEquals(lowest.loadAuto("d", PlacementPolicy::LowestStack), at(2, 0, 0)), "lowest stack picked another stack")
+
+    Ship<string> balanced{X{3}, Y{2}, Height{3}, restrictions};
+    balanced.load(X{0}, Y{0}, "a");
+    AssertCondition(posEquals(balanced.loadAuto("b", PlacementPolicy::Balanced), at(2, 0, 0)), "balanced picked another stack")
+    AssertCondition(posEquals(balanced.loadAuto("c", PlacementPolicy::Balanced), at(2, 1, 0)), "balanced picked another stack")
+    balanced.move(X{2}, Y{1}, X{2}, Y{0});
+    AssertCondition(posEquals(balanced.loadAuto("d", PlacementPolicy::Balanced), at(2, 1, 0)), "balanced missed the moved container")
+
+    // A full ship can't take more
+    for (auto policy: {PlacementPolicy::FirstFit, PlacementPolicy::BestFit, PlacementPolicy::LowestStack, PlacementPolicy::Balanced}) {
+        Ship<int> ship{X{3}, Y{2}, Height{3}, restrictions};
+        for (int i = 0; i < 12; ++i) {
+            AssertCondition(ship.tryLoadAuto(i, policy).hasValue(), "ship with space rejected a container")
+        }
+        auto result = ship.tryLoadAuto(12, policy);
+        AssertCondition(!result && result.error().code == ShipErrorCode::NoSpaceOnShip, "full ship took a container")
+        AssertException(ship.loadAuto(12, policy), "full ship took a container")
+        AssertEquals(ship.getContainersCountByRegion(X{0}, Y{0}, X{2}, Y{1}), 12)
+    }
+
+    // A moved-from ship has no stacks to pick
+    Ship<string> moved = std::move(firstFit);
+    AssertCondition(!firstFit.tryLoadAuto("g"), "moved-from ship took a container")
+}
+
+inline void testShipLayers() {
+    Ship<string> myShip{X{3}, Y{3}, Height{4}, {{X{1}, Y{1}, Height{1}}}};
+    myShip.load(X{0}, Y{0}, "a0");
+    myShip.load(X{0}, Y{0}, "a1");
+    myShip.load(X{1}, Y{1}, "b0");
+    myShip.load(X{2}, Y{1}, "c0");
+    myShip.load(X{2}, Y{1}, "c1");
+    myShip.load(X{2}, Y{1}, "c2");
+
+    auto layerOf = [&](int height) {
+        ViewPair<string> layer;
+        for (auto [pos, container]: myShip.getContainersViewByLayer(Height{height})) {
+            AssertEquals(std::get<2>(pos), height)
+            layer.emplace_back(pos, container);
+        }
+        sortPairs(layer);
+        return layer;
+    };
+    auto bottom = layerOf(0);
+    AssertEquals(bottom.size(), 3)
+    AssertCondition(posEquals(bottom[0].first, {X{0}, Y{0}, Height{0}}) && bottom[0].second == "a0", "bottom layer is invalid")
+    AssertCondition(posEquals(bottom[2].first, {X{2}, Y{1}, Height{0}}) && bottom[2].second == "c0", "bottom layer is invalid")
+    AssertEquals(layerOf(1).size(), 2)
+    AssertEquals(layerOf(2).size(), 1)
+    AssertEquals(layerOf(3).size(), 0)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByLayer(Height{4})), 0)
+    AssertEquals(std::ranges::distance(myShip.getContainersViewByLayer(Height{-1})), 0)
+
+    // Views follow the layer as containers are unloaded and moved
+    auto middle = myShip.getContainersViewByLayer(Height{1});
+    myShip.unload(X{0}, Y{0});
+    myShip.move(X{2}, Y{1}, X{0}, Y{0});
+    auto moved = layerOf(1);
+    AssertEquals(std::ranges::distance(middle), 2)
+    AssertCondition(posEquals(moved[0].first, {X{2}, Y{1}, Height{1}}) && moved[0].second == "c1", "layer lost a container")
+    AssertCondition(posEquals(moved[1].first, {X{0}, Y{0}, Height{1}}) && moved[1].second == "c2", "moved container isn't in its layer")
+    AssertEquals(layerOf(2).size(), 0)
+
+    // Layer-major iteration goes over the whole ship from the bottom up
+    int previousHeight = 0, count = 0;
+    for (auto [pos, container]: myShip.getContainersViewByLayers()) {
+        AssertCondition(std::get<2>(pos) >= previousHeight, "layers out of order")
+        previousHeight = std::get<2>(pos);
+        count++;
+    }
+    AssertEquals(count, 5)
+
+    // Layer views follow a moved ship
+    auto all = myShip.getContainersViewByLayers();
+    Ship<string> movedShip = std::move(myShip);
+    movedShip.load(X{2}, Y{2}, "d0");
+    for (auto [pos, container]: middle) {
+        AssertEquals(container.substr(0, 1), "c")
+    }
+    AssertEquals(std::ranges::distance(middle), 2)
+    AssertEquals(std::ranges::distance(all), 6)
+}
+
+inline void testCopyOnWriteShipEmptyPositionView() {
+    CopyOnWriteShip<string> ship{X{2}, Y{2}, Height{3}};
+    auto view00 = ship.getContainersViewByPosition(X{0}, Y{0});
+    AssertCondition(view00.begin() == view00.end(), "expected empty position view")
+
+    ship.load(X{0}, Y{0}, "hello");
+    auto plan = ship.clone();
+    auto planView = plan.getContainersViewByPosition(X{0}, Y{0});
+    plan.load(X{0}, Y{0}, "bye");  // detaches the stack from the origin
+    AssertEquals(*view00.begin(), "hello")
+    AssertEquals(*planView.begin(), "bye")
+    AssertEquals(std::ranges::distance(planView), 2)
+    AssertEquals(std::ranges::distance(view00), 1)
+
+    // Views follow a ship moved into a fleet
+    auto region = plan.getContainersViewByRegion(X{0}, Y{0}, X{1}, Y{1});
+    vector<CopyOnWriteShip<string>> fleet;
+    fleet.push_back(std::move(plan));
+    fleet.push_back(fleet[0].clone());
+    fleet[0].load(X{0}, Y{0}, "again");
+    AssertEquals(*planView.begin(), "again")
+    AssertEquals(std::ranges::distance(planView), 3)
+    AssertEquals(std::ranges::distance(region), 3)
+    AssertEquals(std::ranges::distance(fleet[1].getContainersViewByPosition(X{0}, Y{0})), 2)
+}
+
+inline void testConcurrentShipEmptyPositionView() {
+    ConcurrentShip<string> ship{X{2}, Y{2}, Height{3}};
+    auto view00 = ship.getContainersViewByPosition(X{0}, Y{0});
+    AssertCondition(view00.begin() == view00.end(), "expected empty position view")
+
+    ship.load(X{0}, Y{0}, "hello");
+    auto snapshot = ship.snapshot();  // the next load copies the stack
+    ship.load(X{0}, Y{0}, "bye");
+    AssertEquals(*view00.begin(), "bye")
+    AssertEquals(std::ranges::distance(view00), 2)
+}
+
+inline void testCopyOnWriteShipGroupsByBay() {
+    Grouping<string> groupingFunctions = {
+            {"first_letter",
+                    [](const string &s) { return string(1, s[0]); }
+            }
+    };
+    using Query = CopyOnWriteShip<string>::Query;
+    CopyOnWriteShip<string> original{X{3}, Y{2}, Height{3}, {}, groupingFunctions};
+    original.registerAggregate("length", [](const string &s) { return double(s.size()); });
+    original.load(X{0}, Y{0}, "hello");
+    original.load(X{1}, Y{1}, "hi");
+    original.load(X{2}, Y{0}, "bye");
+    auto plan = original.clone();
+    auto planH = plan.getContainersViewByGroup("first_letter", "h");
+
+    // Moves across bays keep the container in its group, the origin keeps its own groups
+    plan.move(X{0}, Y{0}, X{2}, Y{1});
+    plan.load(X{2}, Y{1}, "hat");
+    ViewPair<string> pairs;
+    for (auto &pair: planH) {
+        pairs.push_back(pair);
+    }
+    sortPairs(pairs);
+    AssertEquals(pairs.size(), 3)
+    AssertCondition((posEquals(pairs[1].first, {X(2), Y(1), Height{0}})), "Position of element is invalid")
+    AssertEquals(pairs[1].second, "hello")
+    AssertEquals(std::ranges::distance(original.getContainersViewByGroup("first_letter", "h")), 2)
+    AssertEquals(plan.groupStats("first_letter", "h").count(), 3)
+    AssertEquals(plan.groupStats("first_letter", "h").aggregate("length")->sum, 10)
+    AssertEquals(plan.groupStats("first_letter", "h").aggregate("length")->min, 2)
+    AssertEquals(original.groupStats("first_letter", "h").aggregate("length")->max, 5)
+    AssertEquals(plan.query(Query::group("first_letter", "h") | Query::group("first_letter", "b")).count(), 4)
+    AssertEquals(original.query(Query::group("first_letter", "h")).count(), 2)
+
+    plan.unload(X{2}, Y{1});
+    plan.unload(X{2}, Y{1});
+    AssertEquals(std::ranges::distance(planH), 1)
+    AssertEquals(std::ranges::distance(plan.getContainersViewByGroup("first_letter", "z")), 0)
+    AssertEquals(std::ranges::distance(plan.getContainersViewByGroup("no_such_grouping", "h")), 0)
+
+    // Batches are split by bay
+    CopyOnWriteShip<string> batchShip{X{10}, Y{10}, Height{30}, {}, groupingFunctions};
+    vector<tuple<X, Y, string>> batch;
+    for (int i = 0; i < 2000; ++i) {
+        batch.emplace_back(X{i / 10 % 10}, Y{i % 10}, string(1, char('a' + i % 3)) + to_string(i));
+    }
+    batchShip.loadBatch(batch);
+    AssertEquals(batchShip.groupStats("first_letter", "b").count(), 667)
+    auto batchClone = batchShip.clone();
+    batchClone.unload(X{0}, Y{0});
+    int bCount = 0;
+    for (auto &[pos, container]: batchShip.getContainersViewByGroup("first_letter", "b")) {
+        AssertEquals(container[0], 'b')
+        bCount++;
+    }
+    AssertEquals(bCount, 667)
+}
+
 #define testPassed(name) cout << name << " passed" << endl;
 
 inline void executeTests() {
@@ -523,6 +1986,90 @@ inline void executeTests() {
 
     testLoadWhenThereIsNoPlace();
     testPassed("testLoadWhenThereIsNoPlace")
+
+    testShipContainerAddressStable();
+    testPassed("testShipContainerAddressStable")
+
+    testShipIteratorSparseShip();
+    testPassed("testShipIteratorSparseShip")
+
+    testShipViewByGroupAfterManyUnloads();
+    testPassed("testShipViewByGroupAfterManyUnloads")
+
+    testShipTypedGroupingKeys();
+    testPassed("testShipTypedGroupingKeys")
+
+    testGroupedShip();
+    testPassed("testGroupedShip")
+
+    testShipViewByGroupStringView();
+    testPassed("testShipViewByGroupStringView")
+
+    testShipViewByGroupReclaimedGroup();
+    testPassed("testShipViewByGroupReclaimedGroup")
+
+    testShipMoveKeepsGroups();
+    testPassed("testShipMoveKeepsGroups")
+
+    testShipLoadUnloadWithoutCopies();
+    testPassed("testShipLoadUnloadWithoutCopies")
+
+    testShipLoadBatch();
+    testPassed("testShipLoadBatch")
+
+    testShipTryOperations();
+    testPassed("testShipTryOperations")
+
+    testStaticShip();
+    testPassed("testStaticShip")
+
+    testCopyOnWriteShipClone();
+    testPassed("testCopyOnWriteShipClone")
+
+    testShipMoveKeepsViews();
+    testPassed("testShipMoveKeepsViews")
+
+    testShipContainerIds();
+    testPassed("testShipContainerIds")
+
+    testConcurrentShip();
+    testPassed("testConcurrentShip")
+
+    testConcurrentShipSnapshot();
+    testPassed("testConcurrentShipSnapshot")
+
+    testShipLoadBatchParallelGroups();
+    testPassed("testShipLoadBatchParallelGroups")
+
+    testShipParallelForEach();
+    testPassed("testShipParallelForEach")
+
+    testShipRanges();
+    testPassed("testShipRanges")
+
+    testShipGroupStats();
+    testPassed("testShipGroupStats")
+
+    testShipGroupQuery();
+    testPassed("testShipGroupQuery")
+
+    testShipRegions();
+    testPassed("testShipRegions")
+
+    testShipLoadAuto();
+    testPassed("testShipLoadAuto")
+
+    testShipLayers();
+    testPassed("testShipLayers")
+
+    testCopyOnWriteShipEmptyPositionView();
+    testPassed("testCopyOnWriteShipEmptyPositionView")
+
+    testConcurrentShipEmptyPositionView();
+    testPassed("testConcurrentShipEmptyPositionView")
+
+    testCopyOnWriteShipGroupsByBay();
+    testPassed("testCopyOnWriteShipGroupsByBay")
 }
 
 // endregion